@@ -1,32 +1,100 @@
 #include "bitboard.h"
+#include <chrono>
 #include <iostream>
 
 namespace BB {
 	
-	u64 DiagMask[64];
-	u64 AntiDiagMask[64];
+	Magic RookMagics[64];
+	Magic BishopMagics[64];
 	
-	void init() {
-		for (i32 sq = 0; sq < 64; sq++) {
-			i32 r = rank_of(sq);
-			i32 f = file_of(sq);
+	namespace {
+		u64 RookTable[0x19000];
+		u64 BishopTable[0x1480];
+		
+		// xorshift64* generator; fixed seeds keep the magic search
+		// deterministic and fast.
+		struct PRNG {
+			u64 s;
 			
-			DiagMask[sq] = 0;
-			for (i32 tr = r + 1, tf = f + 1; tr < 8 && tf < 8; tr++, tf++) {
-				DiagMask[sq] |= square_bb(make_square(tr, tf));
-			}
-			for (i32 tr = r - 1, tf = f - 1; tr >= 0 && tf >= 0; tr--, tf--) {
-				DiagMask[sq] |= square_bb(make_square(tr, tf));
+			u64 rand() {
+				s ^= s >> 12;
+				s ^= s << 25;
+				s ^= s >> 27;
+				return s * 2685821657736338717ULL;
 			}
 			
-			AntiDiagMask[sq] = 0;
-			for (i32 tr = r + 1, tf = f - 1; tr < 8 && tf >= 0; tr++, tf--) {
-				AntiDiagMask[sq] |= square_bb(make_square(tr, tf));
-			}
-			for (i32 tr = r - 1, tf = f + 1; tr >= 0 && tf < 8; tr--, tf++) {
-				AntiDiagMask[sq] |= square_bb(make_square(tr, tf));
+			u64 sparse_rand() { return rand() & rand() & rand(); }
+		};
+		
+		void init_magics(Magic* magics, u64* table, bool rook) {
+#ifndef USE_PEXT
+			const u64 seeds[8] = { 728, 10316, 55013, 32803, 12281, 15100, 16645, 255 };
+			
+			static u64 occupancy[4096];
+			static u64 reference[4096];
+			static i32 epoch[4096];
+			i32 cnt = 0;
+#endif
+			u64* attacks = table;
+			
+			for (i32 sq = 0; sq < 64; sq++) {
+				Magic& m = magics[sq];
+				
+				// Board edges are irrelevant blockers unless the slider
+				// itself sits on that edge.
+				u64 edges = ((Rank1 | Rank8) & ~(Rank1 << (8 * rank_of(sq)))) |
+				            ((FileA | FileH) & ~(FileA << file_of(sq)));
+				u64 rays = rook
+					? ((FileA << file_of(sq)) | (Rank1 << (8 * rank_of(sq)))) ^ square_bb(sq)
+					: Tables.DiagMask[sq] | Tables.AntiDiagMask[sq];
+				
+				m.mask = rays & ~edges;
+				m.shift = 64 - popcount(m.mask);
+				m.attacks = attacks;
+				
+				// Enumerate every subset of the mask (carry-rippler).
+				i32 size = 0;
+				u64 b = 0;
+				do {
+#ifdef USE_PEXT
+					m.attacks[m.index(b)] = rook ? rook_attacks_slow(sq, b) : bishop_attacks_slow(sq, b);
+#else
+					occupancy[size] = b;
+					reference[size] = rook ? rook_attacks_slow(sq, b) : bishop_attacks_slow(sq, b);
+#endif
+					size++;
+					b = (b - m.mask) & m.mask;
+				} while (b);
+				
+				attacks += size;
+				
+#ifndef USE_PEXT
+				PRNG rng{seeds[rank_of(sq)]};
+				for (i32 i = 0; i < size; ) {
+					for (m.magic = 0; popcount((m.magic * m.mask) >> 56) < 6; ) {
+						m.magic = rng.sparse_rand();
+					}
+					
+					// epoch[] avoids clearing the attack slice between
+					// failed candidates.
+					for (++cnt, i = 0; i < size; i++) {
+						u32 idx = m.index(occupancy[i]);
+						if (epoch[idx] < cnt) {
+							epoch[idx] = cnt;
+							m.attacks[idx] = reference[i];
+						} else if (m.attacks[idx] != reference[i]) {
+							break;
+						}
+					}
+				}
+#endif
 			}
 		}
+	} // anonymous namespace
+	
+	void init() {
+		init_magics(RookMagics, RookTable, true);
+		init_magics(BishopMagics, BishopTable, false);
 	}
 	
 	void print(u64 bb) {
@@ -44,4 +112,62 @@ namespace BB {
 		std::cout << "  Hex: 0x" << std::hex << bb << std::dec << "\n";
 	}
 	
+	void bench_sliders() {
+		constexpr i32 NumBoards = 4096;
+		constexpr i32 Rounds = 64;
+		
+		static u64 boards[NumBoards];
+		PRNG rng{0x9E3779B97F4A7C15ULL};
+		for (i32 i = 0; i < NumBoards; i++) {
+			boards[i] = rng.rand() & rng.rand();
+		}
+		
+		u64 mismatches = 0;
+		for (i32 i = 0; i < NumBoards; i++) {
+			for (i32 sq = 0; sq < 64; sq++) {
+				if (rook_attacks(sq, boards[i]) != rook_attacks_slow(sq, boards[i])) mismatches++;
+				if (bishop_attacks(sq, boards[i]) != bishop_attacks_slow(sq, boards[i])) mismatches++;
+			}
+			
+			// Set-wise fill against per-piece lookups.
+			u64 rooks = boards[i] & rng.rand();
+			u64 bishops = boards[i] & rng.rand();
+			u64 expected = 0;
+			for (u64 r = rooks; r; ) expected |= rook_attacks(pop_lsb(r), boards[i]);
+			for (u64 b = bishops; b; ) expected |= bishop_attacks(pop_lsb(b), boards[i]);
+			if (slider_attacks(rooks, bishops, boards[i]) != expected) mismatches++;
+		}
+		
+		auto run = [&](auto&& lookup) {
+			u64 sink = 0;
+			auto start = std::chrono::steady_clock::now();
+			for (i32 r = 0; r < Rounds; r++) {
+				for (i32 i = 0; i < NumBoards; i++) {
+					for (i32 sq = 0; sq < 64; sq++) {
+						sink ^= lookup(sq, boards[i] ^ sink);
+					}
+				}
+			}
+			auto end = std::chrono::steady_clock::now();
+			double us = std::chrono::duration<double, std::micro>(end - start).count();
+			return std::make_pair(sink, us);
+		};
+		
+		auto fast = run([](i32 sq, u64 occ) { return queen_attacks(sq, occ); });
+		auto slow = run([](i32 sq, u64 occ) {
+			return rook_attacks_slow(sq, occ) | bishop_attacks_slow(sq, occ);
+		});
+		
+		double lookups = double(Rounds) * NumBoards * 64;
+#ifdef USE_PEXT
+		const char* name = "PEXT";
+#else
+		const char* name = "Magic";
+#endif
+		std::cout << "Mismatches: " << mismatches << "\n";
+		std::cout << name << ": " << static_cast<u64>(lookups / fast.second) << " M queen lookups/s\n";
+		std::cout << "Ray-fill: " << static_cast<u64>(lookups / slow.second) << " M queen lookups/s\n";
+		std::cout << "Checksums match: " << (fast.first == slow.first ? "yes" : "no") << "\n";
+	}
+	
 } // namespace BB
@@ -3,6 +3,10 @@
 
 #include "types.h"
 
+#if defined(USE_PEXT) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace BB {
 	constexpr u64 FileA = 0x0101010101010101ULL;
 	constexpr u64 FileB = FileA << 1;
@@ -39,6 +43,10 @@ namespace BB {
 		return __builtin_popcountll(bb);
 	}
 	
+	inline bool more_than_one(u64 bb) {
+		return bb & (bb - 1);
+	}
+	
 	inline u64 flip(u64 bb) {
 		return __builtin_bswap64(bb);
 	}
@@ -58,8 +66,7 @@ namespace BB {
 	inline u64 south_east(u64 bb) { return (bb >> 7) & NotFileA; }
 	inline u64 south_west(u64 bb) { return (bb >> 9) & NotFileH; }
 	
-	inline u64 knight_attacks(i32 sq) {
-		u64 bb = square_bb(sq);
+	inline u64 knight_attacks_bb(u64 bb) {
 		u64 attacks = 0;
 		
 		attacks |= (bb << 17) & NotFileA;  
@@ -74,12 +81,96 @@ namespace BB {
 		return attacks;
 	}
 	
+	// ------------------------------------------------------------
+	// Compile-time attack tables
+	// ------------------------------------------------------------
+	// Leaper attacks, diagonal masks and the between/line tables are
+	// generated by make_tables() at compile time and live in .rodata.
+	
+	struct AttackTables {
+		u64 Knight[64];
+		u64 King[64];
+		u64 Pawn[2][64];        // [Color][Square]: squares a pawn attacks
+		u64 DiagMask[64];       // a1-h8 direction, excluding the square
+		u64 AntiDiagMask[64];   // h1-a8 direction, excluding the square
+		u64 Between[64][64];    // squares strictly between two aligned squares
+		u64 Line[64][64];       // full line through two aligned squares
+	};
+	
+	constexpr u64 bit_at(i32 rank, i32 file) {
+		return (rank >= 0 && rank < 8 && file >= 0 && file < 8)
+			? 1ULL << (rank * 8 + file) : 0;
+	}
+	
+	constexpr u64 ray_mask(i32 sq, i32 dr, i32 df) {
+		u64 bb = 0;
+		for (i32 r = sq / 8 + dr, f = sq % 8 + df; bit_at(r, f); r += dr, f += df) {
+			bb |= bit_at(r, f);
+		}
+		return bb;
+	}
+	
+	constexpr AttackTables make_tables() {
+		AttackTables t{};
+		constexpr i32 knight_steps[8][2] = {
+			{ 2, 1 }, { 2, -1 }, { -2, 1 }, { -2, -1 },
+			{ 1, 2 }, { 1, -2 }, { -1, 2 }, { -1, -2 }
+		};
+		constexpr i32 dirs[8][2] = {
+			{ 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 },
+			{ 1, 1 }, { -1, -1 }, { 1, -1 }, { -1, 1 }
+		};
+		
+		for (i32 sq = 0; sq < 64; sq++) {
+			i32 r = sq / 8, f = sq % 8;
+			
+			for (const auto& d : knight_steps) t.Knight[sq] |= bit_at(r + d[0], f + d[1]);
+			for (const auto& d : dirs) t.King[sq] |= bit_at(r + d[0], f + d[1]);
+			
+			t.Pawn[White][sq] = bit_at(r + 1, f - 1) | bit_at(r + 1, f + 1);
+			t.Pawn[Black][sq] = bit_at(r - 1, f - 1) | bit_at(r - 1, f + 1);
+			
+			t.DiagMask[sq] = ray_mask(sq, 1, 1) | ray_mask(sq, -1, -1);
+			t.AntiDiagMask[sq] = ray_mask(sq, 1, -1) | ray_mask(sq, -1, 1);
+			
+			for (const auto& d : dirs) {
+				u64 line = ray_mask(sq, d[0], d[1]) | ray_mask(sq, -d[0], -d[1]) | bit_at(r, f);
+				u64 between = 0;
+				for (i32 tr = r + d[0], tf = f + d[1]; bit_at(tr, tf); tr += d[0], tf += d[1]) {
+					t.Between[sq][tr * 8 + tf] = between;
+					t.Line[sq][tr * 8 + tf] = line;
+					between |= bit_at(tr, tf);
+				}
+			}
+		}
+		return t;
+	}
+	
+	inline constexpr AttackTables Tables = make_tables();
+	
+	static_assert(Tables.Knight[B1] == (bit_at(2, 0) | bit_at(2, 2) | bit_at(1, 3)));
+	static_assert(Tables.Between[A1][H8] == 0x0040201008040200ULL);
+	static_assert(Tables.Line[B2][C3] == 0x8040201008040201ULL);
+	static_assert(Tables.Between[A1][B3] == 0 && Tables.Line[A1][B3] == 0);
+	
+	inline u64 knight_attacks(i32 sq) {
+		return Tables.Knight[sq];
+	}
+	
 	inline u64 king_attacks(i32 sq) {
-		u64 bb = square_bb(sq);
-		u64 attacks = north(bb) | south(bb);
-		u64 sides = east(bb) | west(bb);
-		attacks |= sides | north(sides) | south(sides);
-		return attacks;
+		return Tables.King[sq];
+	}
+	
+	inline u64 pawn_attacks(Color c, i32 sq) {
+		return Tables.Pawn[c][sq];
+	}
+	
+	inline u64 between(i32 a, i32 b) {
+		return Tables.Between[a][b];
+	}
+	
+	inline u64 line(i32 a, i32 b) {
+		return Tables.Line[a][b];
 	}
 	
 	template<u64 (*Dir)(u64)>
@@ -94,23 +185,116 @@ namespace BB {
 		return attacks;
 	}
 	
-	extern u64 DiagMask[64];
-	extern u64 AntiDiagMask[64];
+	// Kogge-Stone occluded fill for a whole set of sliders in one
+	// direction. Shift > 0 shifts left, Shift < 0 shifts right; Guard
+	// masks off squares that wrapped around a board edge.
+	template<i32 Shift, u64 Guard>
+	inline u64 fill_attacks(u64 gen, u64 empty) {
+		constexpr i32 S = Shift > 0 ? Shift : -Shift;
+		auto sh = [](u64 b, i32 n) { return Shift > 0 ? b << n : b >> n; };
+		
+		u64 pro = empty & Guard;
+		gen |= pro & sh(gen, S);
+		pro &= sh(pro, S);
+		gen |= pro & sh(gen, 2 * S);
+		pro &= sh(pro, 2 * S);
+		gen |= pro & sh(gen, 4 * S);
+		return sh(gen, S) & Guard;
+	}
 	
-	inline u64 rook_attacks(i32 sq, u64 blockers) {
+	// Union of the attacks of every orthogonal slider in `rooks` and
+	// every diagonal slider in `bishops` (queens belong in both sets).
+	// The AVX2 path runs the four left-shifting and the four
+	// right-shifting directions as two 4-lane fills.
+	inline u64 slider_attacks(u64 rooks, u64 bishops, u64 occupied) {
+		u64 empty = ~occupied;
+#ifdef __AVX2__
+		// Lanes (low to high): N/S, E/W, NE/SW, NW/SE.
+		const __m256i gen = _mm256_set_epi64x(i64(bishops), i64(bishops), i64(rooks), i64(rooks));
+		const __m256i emp = _mm256_set1_epi64x(i64(empty));
+		const __m256i sh1 = _mm256_set_epi64x(7, 9, 1, 8);
+		const __m256i sh2 = _mm256_add_epi64(sh1, sh1);
+		const __m256i sh4 = _mm256_add_epi64(sh2, sh2);
+		const __m256i guard_l = _mm256_set_epi64x(i64(NotFileH), i64(NotFileA), i64(NotFileA), -1);
+		const __m256i guard_r = _mm256_set_epi64x(i64(NotFileA), i64(NotFileH), i64(NotFileH), -1);
+		
+		__m256i gl = gen, pl = _mm256_and_si256(emp, guard_l);
+		__m256i gr = gen, pr = _mm256_and_si256(emp, guard_r);
+		
+		gl = _mm256_or_si256(gl, _mm256_and_si256(pl, _mm256_sllv_epi64(gl, sh1)));
+		gr = _mm256_or_si256(gr, _mm256_and_si256(pr, _mm256_srlv_epi64(gr, sh1)));
+		pl = _mm256_and_si256(pl, _mm256_sllv_epi64(pl, sh1));
+		pr = _mm256_and_si256(pr, _mm256_srlv_epi64(pr, sh1));
+		gl = _mm256_or_si256(gl, _mm256_and_si256(pl, _mm256_sllv_epi64(gl, sh2)));
+		gr = _mm256_or_si256(gr, _mm256_and_si256(pr, _mm256_srlv_epi64(gr, sh2)));
+		pl = _mm256_and_si256(pl, _mm256_sllv_epi64(pl, sh2));
+		pr = _mm256_and_si256(pr, _mm256_srlv_epi64(pr, sh2));
+		gl = _mm256_or_si256(gl, _mm256_and_si256(pl, _mm256_sllv_epi64(gl, sh4)));
+		gr = _mm256_or_si256(gr, _mm256_and_si256(pr, _mm256_srlv_epi64(gr, sh4)));
+		
+		__m256i att = _mm256_or_si256(
+			_mm256_and_si256(_mm256_sllv_epi64(gl, sh1), guard_l),
+			_mm256_and_si256(_mm256_srlv_epi64(gr, sh1), guard_r));
+		__m128i half = _mm_or_si128(_mm256_castsi256_si128(att), _mm256_extracti128_si256(att, 1));
+		return u64(_mm_cvtsi128_si64(half)) | u64(_mm_extract_epi64(half, 1));
+#else
+		return fill_attacks< 8, ~0ULL   >(rooks, empty)   |
+		       fill_attacks<-8, ~0ULL   >(rooks, empty)   |
+		       fill_attacks< 1, NotFileA>(rooks, empty)   |
+		       fill_attacks<-1, NotFileH>(rooks, empty)   |
+		       fill_attacks< 9, NotFileA>(bishops, empty) |
+		       fill_attacks< 7, NotFileH>(bishops, empty) |
+		       fill_attacks<-7, NotFileA>(bishops, empty) |
+		       fill_attacks<-9, NotFileH>(bishops, empty);
+#endif
+	}
+	
+	// Ray-fill slider attacks. Only used to build the magic tables in
+	// BB::init() and as a reference for the "sliderbench" command.
+	inline u64 rook_attacks_slow(i32 sq, u64 blockers) {
 		return ray_attacks<north>(sq, blockers) |
 		       ray_attacks<south>(sq, blockers) |
 		       ray_attacks<east>(sq, blockers)  |
 		       ray_attacks<west>(sq, blockers);
 	}
 	
-	inline u64 bishop_attacks(i32 sq, u64 blockers) {
+	inline u64 bishop_attacks_slow(i32 sq, u64 blockers) {
 		return ray_attacks<north_east>(sq, blockers) |
 		       ray_attacks<north_west>(sq, blockers) |
 		       ray_attacks<south_east>(sq, blockers) |
 		       ray_attacks<south_west>(sq, blockers);
 	}
 	
+	// Fancy magic bitboards. With USE_PEXT (make PEXT=1) the index is
+	// computed with BMI2 pext instead of the multiply-shift.
+	struct Magic {
+		u64  mask;
+		u64  magic;
+		u64* attacks;
+		u32  shift;
+		
+		u32 index(u64 blockers) const {
+#ifdef USE_PEXT
+			return static_cast<u32>(_pext_u64(blockers, mask));
+#else
+			return static_cast<u32>(((blockers & mask) * magic) >> shift);
+#endif
+		}
+	};
+	
+	extern Magic RookMagics[64];
+	extern Magic BishopMagics[64];
+	
+	inline u64 rook_attacks(i32 sq, u64 blockers) {
+		const Magic& m = RookMagics[sq];
+		return m.attacks[m.index(blockers)];
+	}
+	
+	inline u64 bishop_attacks(i32 sq, u64 blockers) {
+		const Magic& m = BishopMagics[sq];
+		return m.attacks[m.index(blockers)];
+	}
+	
 	inline u64 queen_attacks(i32 sq, u64 blockers) {
 		return rook_attacks(sq, blockers) | bishop_attacks(sq, blockers);
 	}
@@ -119,6 +303,9 @@ namespace BB {
 	
 	void print(u64 bb);
 	
+	// Checks the magic tables against ray-fill and compares their speed.
+	void bench_sliders();
+	
 } // namespace BB
 
 #endif // BITBOARD_H
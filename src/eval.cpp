@@ -2,6 +2,8 @@
 #include "position.h"
 #include "bitboard.h"
 #include <algorithm>
+#include <atomic>
+#include <iostream>
 
 namespace Eval {
 
@@ -182,16 +184,67 @@ namespace Eval {
 		return phase_inc;
 	}
 	
+	// ------------------------------------------------------------
+	// Eval cache (make EVALCACHE=1)
+	// Hit counters are kept per cache and flushed to the shared totals
+	// at the end of each search.
+	// ------------------------------------------------------------
+#ifdef USE_EVAL_CACHE
+	namespace {
+		std::atomic<u64> total_probes{0}, total_hits{0};
+	} // anonymous namespace
+#endif
+	
+	static i32 compute(const Position& pos);
+	
 	i32 evaluate(const Position& pos) {
+		return compute(pos);
+	}
+	
+#ifdef USE_EVAL_CACHE
+	i32 EvalCache::probe(const Position& pos) {
+		Entry& e = entries[pos.key & (Size - 1)];
+		u32 check = static_cast<u32>(pos.key >> 32);
+		probes++;
+		if (e.check == check) {
+			hits++;
+			return e.eval;
+		}
+		e.check = check;
+		e.eval = compute(pos);
+		return e.eval;
+	}
+	
+	void EvalCache::flush_stats() {
+		total_probes.fetch_add(probes, std::memory_order_relaxed);
+		total_hits.fetch_add(hits, std::memory_order_relaxed);
+		probes = hits = 0;
+	}
+#endif
+	
+	void print_cache_stats() {
+#ifdef USE_EVAL_CACHE
+		u64 probes = total_probes.load(std::memory_order_relaxed);
+		u64 hits = total_hits.load(std::memory_order_relaxed);
+		std::cout << "Eval cache probes: " << probes << "\n";
+		std::cout << "Eval cache hits: " << hits;
+		if (probes) std::cout << " (" << hits * 1000 / probes / 10.0 << "%)";
+		std::cout << "\n";
+#else
+		std::cout << "info string eval cache disabled (build with make EVALCACHE=1)" << std::endl;
+#endif
+	}
+	
+	static i32 compute(const Position& pos) {
 		// Fast path: use incremental PSQT & phase stored inside Position.
 		// Fallback path: recompute if the position was created before Eval::init.
-		Score s0, s1;
+		Score diff;
 		i32 phase = 0;
 		if (pos.eval_ready) {
-			s0 = pos.psqt_sum[0];
-			s1 = pos.psqt_sum[1];
+			diff = unpack_score(pos.psqt);
 			phase = pos.gamePhase;
 		} else {
+			Score s0, s1;
 			for (int pt = Pawn; pt <= King; pt++) {
 				u64 our = pos.colour[0] & pos.pieces[pt];
 				while (our) {
@@ -207,9 +260,9 @@ namespace Eval {
 					phase += phase_inc[pt];
 				}
 			}
+			diff = s0 - s1;
 		}
 
-		Score diff = s0 - s1;
 		i32 mgPhase = std::min(phase, 24);
 		i32 egPhase = 24 - mgPhase;
 		return (diff.mg * mgPhase + diff.eg * egPhase) / 24;
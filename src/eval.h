@@ -15,6 +15,31 @@ namespace Eval {
 	const i32* phase_increments();
 
 	i32 evaluate(const Position& pos);
+	// Eval cache counters summed over all threads (UCI "evalstats").
+	void print_cache_stats();
+	
+#ifdef USE_EVAL_CACHE
+	// Direct-mapped cache in front of evaluate(). Each Searcher owns one,
+	// so it needs no locking and stays warm from one search to the next.
+	class EvalCache {
+	public:
+		i32 probe(const Position& pos);
+		// Adds the counts since the last flush to the shared totals.
+		void flush_stats();
+		
+	private:
+		static constexpr size_t Size = 1 << 13;     // 64 KB
+		
+		struct Entry {
+			u32 check;      // high half of the key
+			i32 eval;
+		};
+		
+		Entry entries[Size] = {};
+		u64 probes = 0;
+		u64 hits = 0;
+	};
+#endif
 }
 
 #endif // EVAL_H
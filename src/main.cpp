@@ -5,6 +5,7 @@
 #include "eval.h"
 #include "search.h"
 #include "tt.h"
+#include "numa.h"
 #include "uci.h"
 #include <iostream>
 
@@ -14,6 +15,10 @@ int main(int argc, char* argv[]) {
 	Zobrist::init();
 	Eval::init();
 	Search::init();
+	Numa::init();
+	// The default table was allocated during static init, before the
+	// node topology was known.
+	if (Numa::node_count() > 1) tt.resize(tt.size_mb());
 	
 	// Run UCI loop
 	UCI::loop();
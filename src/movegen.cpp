@@ -1,19 +1,28 @@
 #include "movegen.h"
 #include "bitboard.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 namespace {
-	void generate_pawn_moves(Move* movelist, i32& count, u64 to_mask, i32 offset) {
+	void generate_pawn_moves(Move* movelist, i32& count, u64 to_mask, i32 offset, i32 flags) {
 		while (to_mask) {
 			i32 to = BB::pop_lsb(to_mask);
 			i32 from = to + offset;
 			if (rank_of(to) == 7) {
-				movelist[count++] = Move(from, to, Queen);
-				movelist[count++] = Move(from, to, Rook);
-				movelist[count++] = Move(from, to, Bishop);
-				movelist[count++] = Move(from, to, Knight);
+				i32 promo = flags | Promotion;
+				movelist[count++] = Move(from, to, promo | (Queen - Knight));
+				movelist[count++] = Move(from, to, promo | (Rook - Knight));
+				movelist[count++] = Move(from, to, promo | (Bishop - Knight));
+				movelist[count++] = Move(from, to, promo);
 			} else {
-				movelist[count++] = Move(from, to, None);
+				movelist[count++] = Move(from, to, flags);
 			}
 		}
 	}
@@ -21,6 +30,7 @@ namespace {
 	void generate_piece_moves(const Position& pos, Move* movelist, i32& count, u64 to_mask) {
 		u64 pieces = pos.colour[0] & pos.pieces[PT];
 		u64 all = pos.all_pieces();
+		u64 them = pos.colour[1];
 		while (pieces) {
 			i32 from = BB::pop_lsb(pieces);
 			u64 attacks;
@@ -39,117 +49,312 @@ namespace {
 			
 			attacks &= to_mask;
 			
-			while (attacks) {
-				i32 to = BB::pop_lsb(attacks);
-				movelist[count++] = Move(from, to, None);
+			u64 captures = attacks & them;
+			u64 quiets = attacks ^ captures;
+			while (captures) {
+				movelist[count++] = Move(from, BB::pop_lsb(captures), Capture);
+			}
+			while (quiets) {
+				movelist[count++] = Move(from, BB::pop_lsb(quiets), Quiet);
+			}
+		}
+	}
+	
+	// Pseudo-legal moves. Non-king moves are limited to squares in
+	// `target`, which generate_legal() uses to restrict check evasions
+	// to captures of the checker and blocks.
+	i32 generate_all(const Position& pos, Move* movelist, GenType type, u64 target) {
+		i32 count = 0;
+		
+		u64 all = pos.all_pieces();
+		u64 us = pos.colour[0];
+		u64 them = pos.colour[1];
+		
+		u64 king_mask = type == GEN_CAPTURES ? them : type == GEN_QUIETS ? ~all : ~us;
+		u64 to_mask = king_mask & target;
+		
+		u64 pawns = us & pos.pieces[Pawn];
+		
+		if (type == GEN_ALL) {
+			u64 push1 = BB::north(pawns) & ~all;
+			u64 push2 = BB::north(push1 & BB::Rank3) & ~all;
+			generate_pawn_moves(movelist, count, push1 & target, -8, Quiet);
+			generate_pawn_moves(movelist, count, push2 & target, -16, DoublePush);
+		} else if (type == GEN_QUIETS) {
+			// Push promotions belong to GEN_CAPTURES.
+			u64 push1 = BB::north(pawns & ~BB::Rank7) & ~all;
+			u64 push2 = BB::north(push1 & BB::Rank3) & ~all;
+			generate_pawn_moves(movelist, count, push1 & target, -8, Quiet);
+			generate_pawn_moves(movelist, count, push2 & target, -16, DoublePush);
+		}
+		
+		// En passant is left to the legality filter, even when in check.
+		if (type != GEN_QUIETS) {
+			u64 capture_targets = them & target;
+			u64 ep = pos.ep_bb();
+			generate_pawn_moves(movelist, count, BB::north_west(pawns) & capture_targets, -7, Capture);
+			generate_pawn_moves(movelist, count, BB::north_east(pawns) & capture_targets, -9, Capture);
+			generate_pawn_moves(movelist, count, BB::north_west(pawns) & ep, -7, EnPassant);
+			generate_pawn_moves(movelist, count, BB::north_east(pawns) & ep, -9, EnPassant);
+		}
+		
+		if (type == GEN_CAPTURES) {
+			u64 promo_push = BB::north(pawns & BB::Rank7) & ~all & target;
+			generate_pawn_moves(movelist, count, promo_push, -8, Quiet);
+		}
+		
+		generate_piece_moves<Knight>(pos, movelist, count, to_mask);
+		generate_piece_moves<Bishop>(pos, movelist, count, to_mask);
+		generate_piece_moves<Rook>(pos, movelist, count, to_mask);
+		generate_piece_moves<Queen>(pos, movelist, count, to_mask);
+		generate_piece_moves<King>(pos, movelist, count, king_mask);
+		
+		if (type != GEN_CAPTURES && !pos.checkers) {
+			i32 king_sq = BB::lsb(us & pos.pieces[King]);
+			u64 rooks = us & pos.pieces[Rook];
+			
+			bool can_oo = (pos.castling & OurOO) && king_sq == E1 &&
+				(rooks & BB::square_bb(H1)) && !(all & 0x60ULL);
+			bool can_ooo = (pos.castling & OurOOO) && king_sq == E1 &&
+				(rooks & BB::square_bb(A1)) && !(all & 0x0EULL);
+			
+			if (can_oo || can_ooo) {
+				u64 attacked = pos.attacks_by();
+				
+				if (can_oo && !(attacked & 0x70ULL)) {
+					movelist[count++] = Move(E1, G1, KingCastle);
+				}
+				if (can_ooo && !(attacked & 0x1CULL)) {
+					movelist[count++] = Move(E1, C1, QueenCastle);
+				}
 			}
 		}
+		
+		return count;
 	}
 	
 } // anonymous namespace
 
-i32 generate_moves(const Position& pos, Move* movelist, bool only_captures) {
-	i32 count = 0;
-	
-	u64 all = pos.all_pieces();
-	u64 us = pos.colour[0];
-	u64 them = pos.colour[1];
+i32 generate_moves(const Position& pos, Move* movelist, GenType type) {
+	return generate_all(pos, movelist, type, ~0ULL);
+}
+
+i32 generate_legal(const Position& pos, Move* movelist, GenType type) {
+	i32 king_sq = BB::lsb(pos.colour[0] & pos.pieces[King]);
+	u64 target = ~0ULL;
 	
-	u64 to_mask = only_captures ? them : ~us;
+	if (pos.checkers) {
+		// Double check: only the king may move.
+		target = BB::more_than_one(pos.checkers)
+			? 0 : pos.checkers | BB::between(king_sq, BB::lsb(pos.checkers));
+	}
 	
-	u64 pawns = us & pos.pieces[Pawn];
+	i32 count = generate_all(pos, movelist, type, target);
 	
-	if (!only_captures) {
-		u64 push1 = BB::north(pawns) & ~all;
-		generate_pawn_moves(movelist, count, push1, -8);
-		
-		u64 push2 = BB::north(push1 & BB::Rank3) & ~all;
-		generate_pawn_moves(movelist, count, push2, -16);
+	// With evasions already targeted, only king moves, moves of pinned
+	// pieces and en passant can still be illegal.
+	u64 risky = pos.pinned | BB::square_bb(king_sq);
+	i32 legal = 0;
+	for (i32 i = 0; i < count; i++) {
+		const Move& m = movelist[i];
+		bool verify = (risky & BB::square_bb(m.from())) || m.is_ep();
+		if (!verify || pos.is_legal(m)) {
+			movelist[legal++] = m;
+		}
 	}
+	return legal;
+}
+
+// ------------------------------------------------------------
+// Perft hash
+// Lock-free: each slot stores key ^ data next to data, so a slot torn
+// by two writers fails the key check instead of returning a wrong
+// count. data packs the node count above an 8-bit depth.
+// ------------------------------------------------------------
+namespace {
+	struct PerftEntry {
+		std::atomic<u64> check;
+		std::atomic<u64> data;
+	};
 	
-	u64 capture_targets = them | pos.ep;
-	if (only_captures || capture_targets) {
-		u64 capture_nw = BB::north_west(pawns) & capture_targets;
-		u64 capture_ne = BB::north_east(pawns) & capture_targets;
-		generate_pawn_moves(movelist, count, capture_nw, -7);
-		generate_pawn_moves(movelist, count, capture_ne, -9);
-	}
+	constexpr size_t PerftHashEntries = size_t(1) << 21;   // 32 MB
+	PerftEntry* perft_hash = nullptr;
 	
-	if (only_captures) {
-		u64 promo_push = BB::north(pawns & BB::Rank7) & ~all;
-		generate_pawn_moves(movelist, count, promo_push, -8);
+	bool perft_probe(u64 key, i32 depth, u64& nodes) {
+		PerftEntry& e = perft_hash[key & (PerftHashEntries - 1)];
+		u64 data = e.data.load(std::memory_order_relaxed);
+		u64 check = e.check.load(std::memory_order_relaxed);
+		if ((check ^ data) != key || (data & 0xFF) != u64(depth)) return false;
+		nodes = data >> 8;
+		return true;
 	}
 	
-	generate_piece_moves<Knight>(pos, movelist, count, to_mask);
-	generate_piece_moves<Bishop>(pos, movelist, count, to_mask);
-	generate_piece_moves<Rook>(pos, movelist, count, to_mask);
-	generate_piece_moves<Queen>(pos, movelist, count, to_mask);
-	generate_piece_moves<King>(pos, movelist, count, to_mask);
+	void perft_store(u64 key, i32 depth, u64 nodes) {
+		PerftEntry& e = perft_hash[key & (PerftHashEntries - 1)];
+		u64 data = (nodes << 8) | u64(depth);
+		e.check.store(key ^ data, std::memory_order_relaxed);
+		e.data.store(data, std::memory_order_relaxed);
+	}
 	
-	if (!only_captures) {
-		i32 king_sq = BB::lsb(us & pos.pieces[King]);
-		u64 rooks = us & pos.pieces[Rook];
-		
-		if (pos.castling[0] && king_sq == E1) {
-			if ((rooks & BB::square_bb(H1)) &&
-				!(all & 0x60ULL) &&
-				!pos.is_attacked(E1) &&
-				!pos.is_attacked(F1) &&
-				!pos.is_attacked(G1)) {
-				movelist[count++] = Move(E1, G1, None);
-			}
+	void perft_hash_reset() {
+		if (!perft_hash) {
+			perft_hash = new PerftEntry[PerftHashEntries]();
+			return;
 		}
-		
-		if (pos.castling[1] && king_sq == E1) {
-			if ((rooks & BB::square_bb(A1)) &&
-				!(all & 0x0EULL) &&
-				!pos.is_attacked(E1) &&
-				!pos.is_attacked(D1) &&
-				!pos.is_attacked(C1)) {
-				movelist[count++] = Move(E1, C1, None);
-			}
+		for (size_t i = 0; i < PerftHashEntries; i++) {
+			perft_hash[i].check.store(0, std::memory_order_relaxed);
+			perft_hash[i].data.store(0, std::memory_order_relaxed);
 		}
 	}
-	
-	return count;
-}
+} // anonymous namespace
 
 u64 perft(Position& pos, i32 depth) {
+	assert(pos.is_ok());
+	
 	if (depth == 0) return 1;
 	
 	Move movelist[256];
-	i32 num_moves = generate_moves(pos, movelist, false);
+	i32 num_moves = generate_legal(pos, movelist);
+	
+#ifndef NDEBUG
+	for (i32 i = 0; i < num_moves; i++) assert(pos.is_pseudo_legal(movelist[i]));
+#endif
+	
+	// Bulk counting: every generated move is legal.
+	if (depth == 1) return num_moves;
 	
 	u64 nodes = 0;
+	if (perft_hash && perft_probe(pos.key, depth, nodes)) return nodes;
 	
 	for (i32 i = 0; i < num_moves; i++) {
+#ifdef USE_UNMAKE
+		StateInfo st;
+		pos.make_move(movelist[i], st);
+		nodes += perft(pos, depth - 1);
+		pos.unmake_move(movelist[i], st);
+#else
 		Position new_pos = pos;
-		
-		if (new_pos.make_move(movelist[i])) {
-			nodes += perft(new_pos, depth - 1);
-		}
+		new_pos.make_move(movelist[i]);
+		nodes += perft(new_pos, depth - 1);
+#endif
 	}
 	
+	if (perft_hash) perft_store(pos.key, depth, nodes);
 	return nodes;
 }
 
-void perft_divide(Position& pos, i32 depth) {
+u64 perft_parallel(const Position& pos, i32 depth, i32 threads, bool divide) {
+	if (depth <= 0) return 1;
+	
+	// Start every run from an empty table so timings are repeatable.
+	perft_hash_reset();
+	
 	Move movelist[256];
-	i32 num_moves = generate_moves(pos, movelist, false);
+	i32 num_moves = generate_legal(pos, movelist);
+	std::vector<u64> counts(num_moves, 1);
 	
-	u64 total = 0;
+	// Workers take root moves from a shared counter until none are left.
+	std::atomic<i32> next{0};
+	auto worker = [&]() {
+		for (i32 i; (i = next.fetch_add(1)) < num_moves; ) {
+			if (depth > 1) {
+				Position child = pos;
+				child.make_move(movelist[i]);
+				counts[i] = perft(child, depth - 1);
+			}
+		}
+	};
 	
+	threads = std::max(1, std::min(threads, num_moves));
+	std::vector<std::thread> pool;
+	for (i32 t = 1; t < threads; t++) pool.emplace_back(worker);
+	worker();
+	for (auto& th : pool) th.join();
+	
+	u64 total = 0;
 	for (i32 i = 0; i < num_moves; i++) {
-		Position new_pos = pos;
-		
-		if (new_pos.make_move(movelist[i])) {
-			u64 nodes = (depth > 1) ? perft(new_pos, depth - 1) : 1;
-			total += nodes;
-			
+		total += counts[i];
+		if (divide) {
 			std::cout << move_to_string(movelist[i], pos.flipped) 
-			<< ": " << nodes << "\n";
+			<< ": " << counts[i] << "\n";
 		}
 	}
-	
+	return total;
+}
+
+void perft_divide(Position& pos, i32 depth, i32 threads) {
+	u64 total = perft_parallel(pos, depth, threads, true);
 	std::cout << "\nTotal: " << total << "\n";
 }
+
+bool perft_suite(const std::string& path, i32 max_depth, i32 threads) {
+	std::ifstream file(path);
+	if (!file) {
+		std::cout << "info string cannot open " << path << std::endl;
+		return false;
+	}
+	
+	std::vector<std::string> lines;
+	for (std::string line; std::getline(file, line); ) {
+		if (line.find(';') != std::string::npos) lines.push_back(line);
+	}
+	
+	std::vector<std::string> errors(lines.size());
+	std::atomic<u64> total_nodes{0};
+	std::atomic<i32> checks{0}, failed{0};
+	std::atomic<size_t> next{0};
+	
+	auto worker = [&]() {
+		for (size_t i; (i = next.fetch_add(1)) < lines.size(); ) {
+			std::istringstream iss(lines[i]);
+			std::string fen, field;
+			std::getline(iss, fen, ';');
+			fen.erase(fen.find_last_not_of(" \t") + 1);
+			
+			Position pos;
+			pos.set_fen(fen);
+			
+			while (std::getline(iss, field, ';')) {
+				std::istringstream fs(field);
+				char d;
+				i32 depth;
+				u64 expected;
+				if (!(fs >> d >> depth >> expected) || d != 'D') continue;
+				if (depth > max_depth) continue;
+				
+				Position root = pos;
+				u64 nodes = perft(root, depth);
+				total_nodes += nodes;
+				checks++;
+				if (nodes != expected) {
+					failed++;
+					errors[i] += "mismatch: " + fen + " depth " + std::to_string(depth)
+						+ " expected " + std::to_string(expected)
+						+ " got " + std::to_string(nodes) + "\n";
+				}
+			}
+		}
+	};
+	
+	perft_hash_reset();
+	auto start = std::chrono::steady_clock::now();
+	
+	threads = std::max(1, threads);
+	std::vector<std::thread> pool;
+	for (i32 t = 1; t < threads; t++) pool.emplace_back(worker);
+	worker();
+	for (auto& th : pool) th.join();
+	
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	
+	for (const std::string& e : errors) std::cout << e;
+	std::cout << "Positions: " << lines.size() << "\n";
+	std::cout << "Checks: " << checks << " (" << failed << " failed)\n";
+	std::cout << "Nodes: " << total_nodes << "\n";
+	std::cout << "Time: " << elapsed << " ms\n";
+	if (elapsed > 0) {
+		std::cout << "NPS: " << (total_nodes * 1000 / elapsed) << "\n";
+	}
+	return failed == 0;
+}
@@ -3,9 +3,27 @@
 
 #include "types.h"
 #include "position.h"
+#include <string>
 
-i32 generate_moves(const Position& pos, Move* movelist, bool only_captures = false);
+enum GenType {
+	GEN_ALL,
+	GEN_CAPTURES,   // captures, en passant and promotions
+	GEN_QUIETS      // everything else, including castling
+};
+
+// Pseudo-legal moves; may leave the king in check.
+i32 generate_moves(const Position& pos, Move* movelist, GenType type = GEN_ALL);
+// Strictly legal moves, including dedicated check evasions.
+i32 generate_legal(const Position& pos, Move* movelist, GenType type = GEN_ALL);
+
+// Perft. Subtree counts are cached in a shared (key, depth) table, and
+// the root moves are split over `threads` workers.
 u64 perft(Position& pos, i32 depth);
-void perft_divide(Position& pos, i32 depth);
+u64 perft_parallel(const Position& pos, i32 depth, i32 threads, bool divide = false);
+void perft_divide(Position& pos, i32 depth, i32 threads = 1);
+// Checks every "<fen> ;D1 20 ;D2 400 ..." line of an EPD file up to
+// max_depth, spreading positions over `threads` workers. Returns
+// false on any mismatch.
+bool perft_suite(const std::string& path, i32 max_depth, i32 threads);
 
 #endif // MOVEGEN_H
@@ -0,0 +1,167 @@
+#include "movepick.h"
+#include "movegen.h"
+#include <utility>
+
+namespace {
+	const i32 MVV_LVA[6][6] = {
+		// attacker: P    N    B    R    Q    K
+		/* P */    { 15,  14,  13,  12,  11,  10 },
+		/* N */    { 25,  24,  23,  22,  21,  20 },
+		/* B */    { 35,  34,  33,  32,  31,  30 },
+		/* R */    { 45,  44,  43,  42,  41,  40 },
+		/* Q */    { 55,  54,  53,  52,  51,  50 },
+		/* K */    { 0,   0,   0,   0,   0,   0  },
+	};
+
+	i32 capture_score(const Position& pos, const Move& move) {
+		if (move.is_ep()) return 100000 + MVV_LVA[Pawn][Pawn];
+		if (move.is_capture()) {
+			return 100000 + MVV_LVA[pos.piece_on(move.to())][pos.piece_on(move.from())];
+		}
+		return 95000 + move.promo();
+	}
+} // anonymous namespace
+
+MovePicker::MovePicker(const Position& pos, const Move& tt_move, const Move* killers, const i32 (*history)[64])
+	: pos(pos), history(history), tt_move(tt_move), current(0), count(0) {
+	killer[0] = killers[0];
+	killer[1] = killers[1];
+
+	// The TT move may come from a different position that shares the slot.
+	bool valid = !tt_move.is_none() && pos.is_pseudo_legal(tt_move) && pos.is_legal(tt_move);
+	if (valid) {
+		stage = TT_MOVE;
+	} else {
+		this->tt_move = NullMove;
+		stage = pos.checkers ? INIT_EVASIONS : INIT_CAPTURES;
+	}
+}
+
+MovePicker::MovePicker(const Position& pos)
+	: pos(pos), history(nullptr), tt_move(NullMove), stage(QS_INIT_CAPTURES), current(0), count(0) {
+	killer[0] = killer[1] = NullMove;
+}
+
+// A killer is only worth trying if it is a legal quiet move here;
+// captures and promotions already had their turn.
+bool MovePicker::is_refutation(const Move& move) const {
+	return !move.is_none()
+		&& !(move == tt_move)
+		&& move.is_quiet()
+		&& pos.is_pseudo_legal(move)
+		&& pos.is_legal(move);
+}
+
+void MovePicker::score_captures() {
+	for (i32 i = current; i < count; i++) {
+		scores[i] = capture_score(pos, moves[i]);
+	}
+}
+
+void MovePicker::score_quiets() {
+	for (i32 i = current; i < count; i++) {
+		scores[i] = history[moves[i].from()][moves[i].to()];
+	}
+}
+
+void MovePicker::score_evasions() {
+	for (i32 i = current; i < count; i++) {
+		const Move& m = moves[i];
+		scores[i] = m.is_quiet() ? history[m.from()][m.to()] : capture_score(pos, m);
+	}
+}
+
+// Selection sort, one step per call.
+Move MovePicker::pick_best() {
+	i32 best_idx = current;
+	for (i32 i = current + 1; i < count; i++) {
+		if (scores[i] > scores[best_idx]) {
+			best_idx = i;
+		}
+	}
+	if (best_idx != current) {
+		std::swap(moves[current], moves[best_idx]);
+		std::swap(scores[current], scores[best_idx]);
+	}
+	return moves[current++];
+}
+
+Move MovePicker::next_move() {
+	switch (stage) {
+	case TT_MOVE:
+		stage = pos.checkers ? INIT_EVASIONS : INIT_CAPTURES;
+		return tt_move;
+
+	case INIT_CAPTURES:
+		current = 0;
+		count = generate_legal(pos, moves, GEN_CAPTURES);
+		score_captures();
+		stage++;
+		[[fallthrough]];
+
+	case CAPTURES:
+		while (current < count) {
+			Move move = pick_best();
+			if (!(move == tt_move)) return move;
+		}
+		stage++;
+		[[fallthrough]];
+
+	case KILLER_1:
+		stage++;
+		if (is_refutation(killer[0])) return killer[0];
+		killer[0] = NullMove;
+		[[fallthrough]];
+
+	case KILLER_2:
+		stage++;
+		if (!(killer[1] == killer[0]) && is_refutation(killer[1])) return killer[1];
+		killer[1] = NullMove;
+		[[fallthrough]];
+
+	case INIT_QUIETS:
+		current = 0;
+		count = generate_legal(pos, moves, GEN_QUIETS);
+		score_quiets();
+		stage++;
+		[[fallthrough]];
+
+	case QUIETS:
+		while (current < count) {
+			Move move = pick_best();
+			if (!(move == tt_move) && !(move == killer[0]) && !(move == killer[1])) return move;
+		}
+		stage = DONE;
+		return NullMove;
+
+	case INIT_EVASIONS:
+		current = 0;
+		count = generate_legal(pos, moves);
+		score_evasions();
+		stage++;
+		[[fallthrough]];
+
+	case EVASIONS:
+		while (current < count) {
+			Move move = pick_best();
+			if (!(move == tt_move)) return move;
+		}
+		stage = DONE;
+		return NullMove;
+
+	case QS_INIT_CAPTURES:
+		current = 0;
+		count = generate_legal(pos, moves, GEN_CAPTURES);
+		score_captures();
+		stage++;
+		[[fallthrough]];
+
+	case QS_CAPTURES:
+		if (current < count) return pick_best();
+		stage = DONE;
+		return NullMove;
+
+	default:
+		return NullMove;
+	}
+}
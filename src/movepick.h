@@ -0,0 +1,47 @@
+#ifndef MOVEPICK_H
+#define MOVEPICK_H
+
+#include "types.h"
+#include "position.h"
+
+// Hands out moves one at a time in stages, generating each stage only
+// when the previous one is used up: after a cutoff on the TT move or a
+// capture the quiet moves are never generated at all.
+class MovePicker {
+public:
+	// Main search. killers points at the two killer slots for this ply.
+	MovePicker(const Position& pos, const Move& tt_move, const Move* killers, const i32 (*history)[64]);
+	// Quiescence search: captures and promotions only.
+	explicit MovePicker(const Position& pos);
+
+	// Next legal move, or NullMove when there are none left.
+	Move next_move();
+
+private:
+	enum Stage {
+		TT_MOVE,
+		INIT_CAPTURES, CAPTURES,
+		KILLER_1, KILLER_2,
+		INIT_QUIETS, QUIETS,
+		INIT_EVASIONS, EVASIONS,
+		QS_INIT_CAPTURES, QS_CAPTURES,
+		DONE
+	};
+
+	void score_captures();
+	void score_quiets();
+	void score_evasions();
+	Move pick_best();
+	bool is_refutation(const Move& move) const;
+
+	const Position& pos;
+	const i32 (*history)[64];
+	Move tt_move;
+	Move killer[2];
+	i32 stage;
+	i32 current, count;
+	Move moves[256];
+	i32 scores[256];
+};
+
+#endif // MOVEPICK_H
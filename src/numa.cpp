@@ -0,0 +1,117 @@
+#include "numa.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Numa {
+
+	namespace {
+		// From <linux/mempolicy.h>, which is not always installed.
+		constexpr int MPOL_BIND_ = 2;
+		constexpr int MPOL_INTERLEAVE_ = 3;
+		constexpr i32 MaxNodes = 64;
+
+		std::vector<i32> nodes;                 // online node ids
+		std::vector<std::vector<i32>> cpus;     // cpus of each online node
+		Policy current = NUMA_INTERLEAVE;
+
+		// Parses the kernel's list format, e.g. "0-3,8,10-11".
+		std::vector<i32> parse_list(const std::string& text) {
+			std::vector<i32> out;
+			std::istringstream iss(text);
+			std::string range;
+			while (std::getline(iss, range, ',')) {
+				if (range.empty()) continue;
+				size_t dash = range.find('-');
+				i32 lo = std::stoi(range.substr(0, dash));
+				i32 hi = dash == std::string::npos ? lo : std::stoi(range.substr(dash + 1));
+				for (i32 i = lo; i <= hi; i++) out.push_back(i);
+			}
+			return out;
+		}
+
+		std::string read_line(const std::string& path) {
+			std::ifstream file(path);
+			std::string line;
+			std::getline(file, line);
+			return line;
+		}
+	} // anonymous namespace
+
+	void init() {
+		nodes.clear();
+		cpus.clear();
+#if defined(__linux__)
+		for (i32 node : parse_list(read_line("/sys/devices/system/node/online"))) {
+			if (node >= MaxNodes) break;
+			std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+			std::vector<i32> list = parse_list(read_line(path));
+			// Memory-only nodes have no cpus to pin to.
+			if (list.empty()) continue;
+			nodes.push_back(node);
+			cpus.push_back(list);
+		}
+#endif
+	}
+
+	i32 node_count() {
+		return static_cast<i32>(nodes.size());
+	}
+
+	Policy policy() {
+		return current;
+	}
+
+	bool set_policy(const std::string& name) {
+		if (name == "off") current = NUMA_OFF;
+		else if (name == "interleave") current = NUMA_INTERLEAVE;
+		else if (name == "bind") current = NUMA_BIND;
+		else return false;
+		return true;
+	}
+
+	void place_memory(void* addr, size_t len) {
+#if defined(__linux__)
+		if (node_count() < 2 || current == NUMA_OFF) return;
+
+		unsigned long mask = 0;
+		int mode = MPOL_INTERLEAVE_;
+		if (current == NUMA_BIND) {
+			mask = 1UL << nodes[0];
+			mode = MPOL_BIND_;
+		} else {
+			for (i32 node : nodes) mask |= 1UL << node;
+		}
+
+		if (syscall(SYS_mbind, addr, len, mode, &mask, MaxNodes + 1, 0) != 0) {
+			std::cout << "info string mbind failed, hash left on default placement" << std::endl;
+		}
+#else
+		(void)addr; (void)len;
+#endif
+	}
+
+	void bind_thread(i32 index) {
+#if defined(__linux__)
+		if (node_count() < 2 || current == NUMA_OFF) return;
+
+		i32 n = current == NUMA_BIND ? 0 : index % node_count();
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (i32 cpu : cpus[n]) {
+			if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+		}
+		sched_setaffinity(0, sizeof(set), &set);
+#else
+		(void)index;
+#endif
+	}
+
+} // namespace Numa
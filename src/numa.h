@@ -0,0 +1,32 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include "types.h"
+#include <cstddef>
+#include <string>
+
+// NUMA placement for the hash table and search threads. Uses the raw
+// Linux syscalls and /sys topology; everything is a no-op on
+// single-node machines and on other platforms.
+namespace Numa {
+	enum Policy {
+		NUMA_OFF,
+		NUMA_INTERLEAVE,    // spread TT pages over all nodes
+		NUMA_BIND           // keep TT pages and threads on node 0
+	};
+
+	void init();
+	i32 node_count();
+	Policy policy();
+	// Accepts "off", "interleave" or "bind"; false if unknown.
+	bool set_policy(const std::string& name);
+
+	// Applies the memory policy to [addr, addr + len). Must run before
+	// the pages are first touched.
+	void place_memory(void* addr, size_t len);
+	// Pins the calling search thread: thread `index` goes to node
+	// index % node_count() (always node 0 under NUMA_BIND).
+	void bind_thread(i32 index);
+}
+
+#endif // NUMA_H
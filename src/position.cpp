@@ -1,8 +1,27 @@
 #include "position.h"
 #include "eval.h"
+#include "tt.h"
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
+namespace {
+	// Rights that survive a move touching each square.
+	constexpr auto make_castle_masks() {
+		struct { u8 mask[64]; } t{};
+		for (i32 sq = 0; sq < 64; sq++) t.mask[sq] = 0xF;
+		t.mask[E1] = static_cast<u8>(~(OurOO | OurOOO) & 0xF);
+		t.mask[H1] = static_cast<u8>(~OurOO & 0xF);
+		t.mask[A1] = static_cast<u8>(~OurOOO & 0xF);
+		t.mask[E8] = static_cast<u8>(~(TheirOO | TheirOOO) & 0xF);
+		t.mask[H8] = static_cast<u8>(~TheirOO & 0xF);
+		t.mask[A8] = static_cast<u8>(~TheirOOO & 0xF);
+		return t;
+	}
+	
+	constexpr auto CastleMask = make_castle_masks();
+}
+
 Position::Position() {
 	colour[0] = 0x000000000000FFFFULL;
 	colour[1] = 0xFFFF000000000000ULL;
@@ -12,10 +31,16 @@ Position::Position() {
 	pieces[Rook]   = 0x8100000000000081ULL;  
 	pieces[Queen]  = 0x0800000000000008ULL;  
 	pieces[King]   = 0x1000000000000010ULL;  
-	castling[0] = castling[1] = castling[2] = castling[3] = true;
-	ep = 0;
+	for (i32 sq = 0; sq < 64; sq++) {
+		board[sq] = None;
+		for (int pt = Pawn; pt < None; pt++) {
+			if (pieces[pt] & BB::square_bb(sq)) board[sq] = pt;
+		}
+	}
+	castling = OurOO | OurOOO | TheirOO | TheirOOO;
+	ep = NoSquare;
 	flipped = false;
-	psqt_sum[0] = psqt_sum[1] = Score();
+	psqt = 0;
 	gamePhase = 0;
 	eval_ready = false;
 	// This constructor can run at static init (before main), so we only
@@ -23,15 +48,22 @@ Position::Position() {
 	if (Eval::is_ready()) {
 		refresh_eval();
 	}
+	// Zobrist keys are still zero at static init; UCI::loop() refreshes
+	// the key of its global position.
+	key = Zobrist::hash(*this);
+	// No checks or pins in the start position (and the magic tables may
+	// not exist yet).
+	checkers = pinned = 0;
 }
 
 void Position::set_fen(const std::string& fen) {
 	colour[0] = colour[1] = 0;
 	for (int i = 0; i < 6; i++) pieces[i] = 0;
-	for (int i = 0; i < 4; i++) castling[i] = false;
-	ep = 0;
+	for (int i = 0; i < 64; i++) board[i] = None;
+	castling = 0;
+	ep = NoSquare;
 	flipped = false;
-	psqt_sum[0] = psqt_sum[1] = Score();
+	psqt = 0;
 	gamePhase = 0;
 	eval_ready = false;
 	
@@ -64,6 +96,7 @@ void Position::set_fen(const std::string& fen) {
 				u64 bb = BB::square_bb(sq);
 				colour[is_black ? 1 : 0] |= bb;
 				pieces[pt] |= bb;
+				board[sq] = pt;
 			}
 			sq++;
 		}
@@ -72,25 +105,27 @@ void Position::set_fen(const std::string& fen) {
 	bool black_to_move = (side_str == "b");
 	for (char c : castle_str) {
 		switch (c) {
-			case 'K': castling[0] = true; break;
-			case 'Q': castling[1] = true; break;
-			case 'k': castling[2] = true; break;
-			case 'q': castling[3] = true; break;
+			case 'K': castling |= OurOO; break;
+			case 'Q': castling |= OurOOO; break;
+			case 'k': castling |= TheirOO; break;
+			case 'q': castling |= TheirOOO; break;
 		}
 	}
 	if (ep_str != "-" && ep_str.length() >= 2) {
 		i32 file = ep_str[0] - 'a';
 		i32 rank = ep_str[1] - '1';
-		ep = BB::square_bb(make_square(rank, file));
+		ep = make_square(rank, file);
 	}
 	if (black_to_move) {
 		flip();
 	}
 	refresh_eval();
+	key = Zobrist::hash(*this);
+	update_check_info();
 }
 
 void Position::refresh_eval() {
-	psqt_sum[0] = psqt_sum[1] = Score();
+	psqt = 0;
 	gamePhase = 0;
 
 	if (!Eval::is_ready()) {
@@ -103,7 +138,7 @@ void Position::refresh_eval() {
 		u64 our = colour[0] & pieces[pt];
 		while (our) {
 			i32 sq = BB::pop_lsb(our);
-			psqt_sum[0] += Eval::psqt(static_cast<PieceType>(pt), sq);
+			psqt += pack_score(Eval::psqt(static_cast<PieceType>(pt), sq));
 			gamePhase += ph[pt];
 		}
 
@@ -111,7 +146,7 @@ void Position::refresh_eval() {
 		while (their) {
 			i32 sq = BB::pop_lsb(their);
 			i32 flipped_sq = sq ^ 56;
-			psqt_sum[1] += Eval::psqt(static_cast<PieceType>(pt), flipped_sq);
+			psqt -= pack_score(Eval::psqt(static_cast<PieceType>(pt), flipped_sq));
 			gamePhase += ph[pt];
 		}
 	}
@@ -129,36 +164,55 @@ void Position::flip() {
 		pieces[i] = BB::flip(pieces[i]);
 	}
 	
-	ep = BB::flip(ep);
-	std::swap(castling[0], castling[2]);
-	std::swap(castling[1], castling[3]);
+	// Mirror the mailbox by swapping whole ranks.
+	u64 ranks[8];
+	std::memcpy(ranks, board, sizeof(board));
+	for (int r = 0; r < 4; r++) std::swap(ranks[r], ranks[7 - r]);
+	std::memcpy(board, ranks, sizeof(board));
+	
+	if (ep != NoSquare) ep ^= 56;
+	castling = static_cast<u8>(((castling & 3) << 2) | (castling >> 2));
+	key ^= Zobrist::side_key;
 	// Incremental eval update: see Eval::evaluate() logic.
-	// Because we store psqt_sum[0] as "our" sum and psqt_sum[1] as
-	// "their" sum (with their squares already mirrored), a flip is
-	// just a swap.
-	std::swap(psqt_sum[0], psqt_sum[1]);
+	// psqt is "ours minus theirs" with their squares already mirrored,
+	// so a flip just negates it.
+	psqt = -psqt;
 }
 
-PieceType Position::piece_on(i32 sq) const {
-	u64 bb = BB::square_bb(sq);
-	for (int pt = Pawn; pt < None; pt++) {
-		if (pieces[pt] & bb) return static_cast<PieceType>(pt);
-	}
-	return None;
+void Position::make_null_move() {
+	if (ep != NoSquare) key ^= Zobrist::ep_keys[file_of(ep)];
+	ep = NoSquare;
+	flip();
+	update_check_info();
+}
+
+void Position::make_null_move(StateInfo& st) {
+	st.ep = ep;
+	st.key = key;
+	st.checkers = checkers;
+	st.pinned = pinned;
+	make_null_move();
+}
+
+void Position::unmake_null_move(const StateInfo& st) {
+	flip();
+	ep = st.ep;
+	key = st.key;
+	checkers = st.checkers;
+	pinned = st.pinned;
+}
+
+i32 Position::castle_index() const {
+	return flipped ? ((castling & 3) << 2) | (castling >> 2) : castling;
 }
 
 bool Position::is_attacked(i32 sq, bool by_enemy) const {
 	int attacker = by_enemy ? 1 : 0;
 	u64 attackers = colour[attacker];
 	u64 all = all_pieces();
-	u64 pawns = attackers & pieces[Pawn];
-	u64 pawn_attacks;
-	if (by_enemy) {
-		pawn_attacks = BB::south_west(pawns) | BB::south_east(pawns);
-	} else {
-		pawn_attacks = BB::north_west(pawns) | BB::north_east(pawns);
-	}
-	if (pawn_attacks & BB::square_bb(sq)) return true;
+	// Enemy pawns attack sq from the squares our own pawn on sq would
+	// attack, and vice versa.
+	if (BB::pawn_attacks(by_enemy ? White : Black, sq) & attackers & pieces[Pawn]) return true;
 	if (BB::knight_attacks(sq) & attackers & pieces[Knight]) return true;
 	if (BB::bishop_attacks(sq, all) & attackers & pieces[Bishop]) return true;
 	if (BB::rook_attacks(sq, all) & attackers & pieces[Rook]) return true;
@@ -168,115 +222,355 @@ bool Position::is_attacked(i32 sq, bool by_enemy) const {
 	return false;
 }
 
-bool Position::make_move(const Move& move) {
+// All pieces of either colour attacking sq, given an occupancy.
+u64 Position::attackers_to(i32 sq, u64 occupied) const {
+	u64 rooks = pieces[Rook] | pieces[Queen];
+	u64 bishops = pieces[Bishop] | pieces[Queen];
+	return (BB::pawn_attacks(White, sq) & colour[1] & pieces[Pawn])
+	     | (BB::pawn_attacks(Black, sq) & colour[0] & pieces[Pawn])
+	     | (BB::knight_attacks(sq) & pieces[Knight])
+	     | (BB::king_attacks(sq) & pieces[King])
+	     | (BB::rook_attacks(sq, occupied) & rooks)
+	     | (BB::bishop_attacks(sq, occupied) & bishops);
+}
+
+void Position::update_check_info() {
+	i32 king_sq = BB::lsb(colour[0] & pieces[King]);
+	u64 all = all_pieces();
+	
+	checkers = attackers_to(king_sq, all) & colour[1];
+	pinned = 0;
+	
+	// Enemy sliders that would hit the king on an empty board, with
+	// exactly one piece in between.
+	u64 snipers = colour[1] & (
+		(BB::rook_attacks(king_sq, 0) & (pieces[Rook] | pieces[Queen])) |
+		(BB::bishop_attacks(king_sq, 0) & (pieces[Bishop] | pieces[Queen])));
+	while (snipers) {
+		u64 blockers = BB::between(king_sq, BB::pop_lsb(snipers)) & all;
+		if (blockers && !BB::more_than_one(blockers)) {
+			pinned |= blockers & colour[0];
+		}
+	}
+}
+
+// Every square attacked by one side, computed set-wise instead of
+// per piece.
+u64 Position::attacks_by(bool by_enemy) const {
+	u64 attackers = colour[by_enemy ? 1 : 0];
+	u64 pawns = attackers & pieces[Pawn];
+	u64 queens = attackers & pieces[Queen];
+	u64 attacks;
+	if (by_enemy) {
+		attacks = BB::south_west(pawns) | BB::south_east(pawns);
+	} else {
+		attacks = BB::north_west(pawns) | BB::north_east(pawns);
+	}
+	attacks |= BB::knight_attacks_bb(attackers & pieces[Knight]);
+	attacks |= BB::king_attacks(BB::lsb(attackers & pieces[King]));
+	attacks |= BB::slider_attacks((attackers & pieces[Rook]) | queens,
+	                              (attackers & pieces[Bishop]) | queens,
+	                              all_pieces());
+	return attacks;
+}
+
+bool Position::is_legal(const Move& move) const {
+	i32 king_sq = BB::lsb(colour[0] & pieces[King]);
+	u64 from_bb = BB::square_bb(move.from());
+	u64 to_bb = BB::square_bb(move.to());
+	
+	// Castling squares were already checked by the generator.
+	if (move.is_castle()) return true;
+	
+	if (piece_on(move.from()) == King) {
+		return !(attackers_to(move.to(), all_pieces() ^ from_bb) & colour[1]);
+	}
+	
+	if (move.is_ep()) {
+		// Both pawns leave the capture rank, so test the king directly.
+		u64 captured = BB::south(to_bb);
+		u64 occupied = (all_pieces() ^ from_bb ^ captured) | to_bb;
+		return !(attackers_to(king_sq, occupied) & colour[1] & ~captured);
+	}
+	
+	if (checkers) {
+		if (BB::more_than_one(checkers)) return false;
+		if (!(to_bb & (checkers | BB::between(king_sq, BB::lsb(checkers))))) return false;
+	}
+	
+	return !(pinned & from_bb) || (BB::line(king_sq, move.from()) & to_bb);
+}
+
+bool Position::is_pseudo_legal(const Move& move) const {
+	i32 from = move.from(), to = move.to();
+	u64 from_bb = BB::square_bb(from);
+	u64 to_bb = BB::square_bb(to);
+	u64 all = all_pieces();
+	
+	if (from == to || !(colour[0] & from_bb) || (colour[0] & to_bb)) return false;
+	
+	PieceType piece = piece_on(from);
+	bool capture = colour[1] & to_bb;
+	
+	if (piece == Pawn) {
+		if (move.is_castle()) return false;
+		if (bool(to_bb & BB::Rank8) != move.is_promo()) return false;
+		
+		if (BB::pawn_attacks(White, from) & to_bb) {
+			if (to == ep) return move.is_ep();
+			return capture && (move.is_promo() ? move.is_capture() : move.flags() == Capture);
+		}
+		if (move.is_capture() || (all & to_bb)) return false;
+		if (to == from + 8) return !move.is_double_push();
+		return to == from + 16 && move.is_double_push()
+			&& (from_bb & BB::Rank2) && !(all & BB::north(from_bb));
+	}
+	
+	if (move.is_castle()) {
+		// Same conditions as the generator.
+		if (piece != King || from != E1 || checkers) return false;
+		if (move.flags() == KingCastle) {
+			return to == G1 && (castling & OurOO) && (colour[0] & pieces[Rook] & BB::square_bb(H1))
+				&& !(all & 0x60ULL) && !(attacks_by() & 0x70ULL);
+		}
+		return to == C1 && (castling & OurOOO) && (colour[0] & pieces[Rook] & BB::square_bb(A1))
+			&& !(all & 0x0EULL) && !(attacks_by() & 0x1CULL);
+	}
+	
+	if (move.flags() != (capture ? Capture : Quiet)) return false;
+	
+	switch (piece) {
+	case Knight: return BB::knight_attacks(from) & to_bb;
+	case Bishop: return BB::bishop_attacks(from, all) & to_bb;
+	case Rook:   return BB::rook_attacks(from, all) & to_bb;
+	case Queen:  return BB::queen_attacks(from, all) & to_bb;
+	case King:   return BB::king_attacks(from) & to_bb;
+	default:     return false;
+	}
+}
+
+void Position::make_move(const Move& move) {
+	StateInfo st;
+	make_move(move, st);
+}
+
+void Position::make_move(const Move& move, StateInfo& st) {
 	if (!eval_ready) refresh_eval();
 
-	u64 from_bb = BB::square_bb(move.from);
-	u64 to_bb = BB::square_bb(move.to);
+	i32 from = move.from(), to = move.to();
+	u64 from_bb = BB::square_bb(from);
+	u64 to_bb = BB::square_bb(to);
 	u64 move_mask = from_bb | to_bb;
 	
-	PieceType piece = piece_on(move.from);
-	PieceType captured = piece_on(move.to);
-
+	PieceType piece = piece_on(from);
+	PieceType captured = move.is_capture() && !move.is_ep() ? piece_on(to) : None;
+	
+	st.key = key;
+	st.checkers = checkers;
+	st.pinned = pinned;
+	st.psqt = psqt;
+	st.gamePhase = gamePhase;
+	st.castling = castling;
+	st.ep = ep;
+	st.captured = captured;
+	
 	// ------------------------------------------------------------
 	// Incremental eval update (before mutating bitboards)
-	// psqt_sum[0]: our pieces use actual square
-	// psqt_sum[1]: enemy pieces use mirrored square
+	// Our pieces use the actual square, enemy pieces the mirrored one.
 	// ------------------------------------------------------------
 	if (eval_ready && Eval::is_ready()) {
 		const i32* ph = Eval::phase_increments();
 
 		// Remove moving piece from its origin square
-		psqt_sum[0] -= Eval::psqt(piece, move.from);
+		psqt -= pack_score(Eval::psqt(piece, from));
 
 		// Captures (normal capture on destination)
 		if (captured != None) {
-			psqt_sum[1] -= Eval::psqt(captured, move.to ^ 56);
+			psqt += pack_score(Eval::psqt(captured, to ^ 56));
 			gamePhase -= ph[captured];
 		}
 
 		// En-passant capture
-		if (piece == Pawn && to_bb == ep) {
-			i32 cap_sq = move.to - 8;
-			psqt_sum[1] -= Eval::psqt(Pawn, cap_sq ^ 56);
+		if (move.is_ep()) {
+			i32 cap_sq = to - 8;
+			psqt += pack_score(Eval::psqt(Pawn, cap_sq ^ 56));
 			// phase_inc[Pawn] is 0, so no phase change
 		}
 
-		// Castling rook move (king move by 2 squares)
-		if (piece == King) {
-			if (move.to - move.from == 2) {
+		// Castling rook move
+		if (move.is_castle()) {
+			if (move.flags() == KingCastle) {
 				// O-O: rook H1 -> F1
-				psqt_sum[0] -= Eval::psqt(Rook, H1);
-				psqt_sum[0] += Eval::psqt(Rook, F1);
-			} else if (move.from - move.to == 2) {
+				psqt += pack_score(Eval::psqt(Rook, F1) - Eval::psqt(Rook, H1));
+			} else {
 				// O-O-O: rook A1 -> D1
-				psqt_sum[0] -= Eval::psqt(Rook, A1);
-				psqt_sum[0] += Eval::psqt(Rook, D1);
+				psqt += pack_score(Eval::psqt(Rook, D1) - Eval::psqt(Rook, A1));
 			}
 		}
 
 		// Add piece on destination square (promotion handled below)
-		if (piece == Pawn && rank_of(move.to) == 7 && move.promo != None) {
-			psqt_sum[0] += Eval::psqt(static_cast<PieceType>(move.promo), move.to);
-			gamePhase += ph[move.promo];
+		if (move.is_promo()) {
+			psqt += pack_score(Eval::psqt(move.promo(), to));
+			gamePhase += ph[move.promo()];
 		} else {
-			psqt_sum[0] += Eval::psqt(piece, move.to);
+			psqt += pack_score(Eval::psqt(piece, to));
 		}
 	}
 
+	// Incremental Zobrist update. Castling rights and the ep file are
+	// toggled out here and back in once they have been updated.
+	key ^= Zobrist::piece_key(flipped, 0, piece, from)
+	     ^ Zobrist::piece_key(flipped, 0, piece, to)
+	     ^ Zobrist::castle_keys[castle_index()];
+	if (ep != NoSquare) key ^= Zobrist::ep_keys[file_of(ep)];
+
 	colour[0] ^= move_mask;
 	pieces[piece] ^= move_mask;
+	board[from] = None;
+	board[to] = piece;
 
 	if (captured != None) {
 		colour[1] ^= to_bb;
 		pieces[captured] ^= to_bb;
+		key ^= Zobrist::piece_key(flipped, 1, captured, to);
 	}
 
-	if (piece == Pawn && to_bb == ep) {
+	if (move.is_ep()) {
 		u64 captured_pawn = BB::south(to_bb);
 		colour[1] ^= captured_pawn;
 		pieces[Pawn] ^= captured_pawn;
+		board[to - 8] = None;
+		key ^= Zobrist::piece_key(flipped, 1, Pawn, to - 8);
 	}
 
-	ep = 0;
+	ep = NoSquare;
 
-	if (piece == Pawn && (move.to - move.from == 16)) {
-		ep = BB::south(to_bb);
+	if (move.is_double_push()) {
+		ep = to - 8;
+		key ^= Zobrist::ep_keys[file_of(to)];
 	}
 
-	if (piece == King) {
-		if (move.to - move.from == 2) {
+	if (move.is_castle()) {
+		if (move.flags() == KingCastle) {
 			u64 rook_move = BB::square_bb(H1) | BB::square_bb(F1);
 			colour[0] ^= rook_move;
 			pieces[Rook] ^= rook_move;
-		} else if (move.from - move.to == 2) {
+			board[H1] = None;
+			board[F1] = Rook;
+			key ^= Zobrist::piece_key(flipped, 0, Rook, H1) ^ Zobrist::piece_key(flipped, 0, Rook, F1);
+		} else {
 			u64 rook_move = BB::square_bb(A1) | BB::square_bb(D1);
 			colour[0] ^= rook_move;
 			pieces[Rook] ^= rook_move;
+			board[A1] = None;
+			board[D1] = Rook;
+			key ^= Zobrist::piece_key(flipped, 0, Rook, A1) ^ Zobrist::piece_key(flipped, 0, Rook, D1);
 		}
 	}
 	
-	if (piece == Pawn && rank_of(move.to) == 7) {
+	if (move.is_promo()) {
+		PieceType promo = move.promo();
 		pieces[Pawn] ^= to_bb;
-		pieces[move.promo] ^= to_bb;
+		pieces[promo] ^= to_bb;
+		board[to] = promo;
+		key ^= Zobrist::piece_key(flipped, 0, Pawn, to)
+		     ^ Zobrist::piece_key(flipped, 0, promo, to);
 	}
 	
-	if (move_mask & BB::square_bb(E1)) {
-		castling[0] = castling[1] = false;  
-	}
-	if (move_mask & BB::square_bb(H1)) castling[0] = false;  
-	if (move_mask & BB::square_bb(A1)) castling[1] = false;  
-	if (move_mask & BB::square_bb(E8)) {
-		castling[2] = castling[3] = false;  
-	}
-	if (move_mask & BB::square_bb(H8)) castling[2] = false;  
-	if (move_mask & BB::square_bb(A8)) castling[3] = false;  
+	castling &= CastleMask.mask[from] & CastleMask.mask[to];
+	key ^= Zobrist::castle_keys[castle_index()];
 
 	flip();
+	update_check_info();
+}
 
-	i32 my_king_sq = BB::lsb(colour[1] & pieces[King]);
+// Reverses make_move(). The board is flipped back first, so all square
+// arithmetic below is from the mover's point of view again.
+void Position::unmake_move(const Move& move, const StateInfo& st) {
+	flip();
+	
+	i32 from = move.from(), to = move.to();
+	u64 from_bb = BB::square_bb(from);
+	u64 to_bb = BB::square_bb(to);
+	u64 move_mask = from_bb | to_bb;
+	PieceType piece = piece_on(to);
+	PieceType captured = static_cast<PieceType>(st.captured);
+	
+	if (move.is_promo()) {
+		pieces[move.promo()] ^= to_bb;
+		pieces[Pawn] ^= to_bb;
+		piece = Pawn;
+	}
 	
-	return !is_attacked(my_king_sq, false);  
+	colour[0] ^= move_mask;
+	pieces[piece] ^= move_mask;
+	board[from] = piece;
+	board[to] = captured;
+	
+	if (captured != None) {
+		colour[1] ^= to_bb;
+		pieces[captured] ^= to_bb;
+	}
+	
+	if (move.is_ep()) {
+		u64 captured_pawn = BB::south(to_bb);
+		colour[1] ^= captured_pawn;
+		pieces[Pawn] ^= captured_pawn;
+		board[to - 8] = Pawn;
+	}
+	
+	if (move.is_castle()) {
+		if (move.flags() == KingCastle) {
+			u64 rook_move = BB::square_bb(H1) | BB::square_bb(F1);
+			colour[0] ^= rook_move;
+			pieces[Rook] ^= rook_move;
+			board[H1] = Rook;
+			board[F1] = None;
+		} else {
+			u64 rook_move = BB::square_bb(A1) | BB::square_bb(D1);
+			colour[0] ^= rook_move;
+			pieces[Rook] ^= rook_move;
+			board[A1] = Rook;
+			board[D1] = None;
+		}
+	}
+	
+	key = st.key;
+	psqt = st.psqt;
+	gamePhase = st.gamePhase;
+	castling = st.castling;
+	ep = st.ep;
+	checkers = st.checkers;
+	pinned = st.pinned;
+}
+
+// Consistency check between the bitboards, the mailbox and the
+// incremental key and check info. Used by
+// assert() in debug builds (make DEBUG=1).
+bool Position::is_ok() const {
+	if (colour[0] & colour[1]) return false;
+	
+	u64 occupied = 0;
+	for (int pt = Pawn; pt < None; pt++) {
+		if (occupied & pieces[pt]) return false;
+		occupied |= pieces[pt];
+	}
+	if (occupied != all_pieces()) return false;
+	
+	for (i32 sq = 0; sq < 64; sq++) {
+		PieceType pt = piece_on(sq);
+		if (pt == None) {
+			if (occupied & BB::square_bb(sq)) return false;
+		} else if (!(pieces[pt] & BB::square_bb(sq))) {
+			return false;
+		}
+	}
+	
+	Position fresh = *this;
+	fresh.update_check_info();
+	if (fresh.checkers != checkers || fresh.pinned != pinned) return false;
+	
+	return key == Zobrist::hash(*this);
 }
 
 void Position::print() const {
@@ -292,12 +586,10 @@ void Position::print() const {
 			u64 bb = BB::square_bb(sq);
 			
 			char c = '.';
-			for (int pt = Pawn; pt < None; pt++) {
-				if (pieces[pt] & bb) {
-					bool is_enemy = colour[1] & bb;
-					c = piece_chars[pt + (is_enemy ? 6 : 0)];
-					break;
-				}
+			PieceType pt = piece_on(sq);
+			if (pt != None) {
+				bool is_enemy = colour[1] & bb;
+				c = piece_chars[pt + (is_enemy ? 6 : 0)];
 			}
 			std::cout << c << ' ';
 		}
@@ -308,15 +600,16 @@ void Position::print() const {
 	
 	std::cout << "  Flipped: " << (flipped ? "yes (black to move)" : "no (white to move)") << "\n";
 	std::cout << "  Castling: ";
-	if (castling[0]) std::cout << "K";
-	if (castling[1]) std::cout << "Q";
-	if (castling[2]) std::cout << "k";
-	if (castling[3]) std::cout << "q";
-	if (!castling[0] && !castling[1] && !castling[2] && !castling[3]) std::cout << "-";
+	i32 rights = castle_index();
+	if (rights & OurOO) std::cout << "K";
+	if (rights & OurOOO) std::cout << "Q";
+	if (rights & TheirOO) std::cout << "k";
+	if (rights & TheirOOO) std::cout << "q";
+	if (!rights) std::cout << "-";
 	std::cout << "\n";
 	
-	if (ep) {
-		i32 ep_sq = BB::lsb(ep);
+	if (ep != NoSquare) {
+		i32 ep_sq = ep;
 		std::cout << "  En passant: " << char('a' + file_of(ep_sq)) << (rank_of(ep_sq) + 1) << "\n";
 	}
 	std::cout << "\n";
@@ -5,25 +5,74 @@
 #include "bitboard.h"
 #include <string>
 
-struct Position {
+// Castling rights bits, relative to the side to move like the board.
+enum CastlingRight : u8 {
+	OurOO     = 1,
+	OurOOO    = 2,
+	TheirOO   = 4,
+	TheirOOO  = 8
+};
+
+// Everything make_move() overwrites and unmake_move() cannot recompute.
+struct StateInfo {
+	u64 key;
+	u64 checkers;
+	u64 pinned;
+	i32 psqt;
+	u8 gamePhase;
+	u8 castling;
+	u8 ep;
+	u8 captured;
+};
+
+// Bitboards, mailbox and a compact state block: 3 cache lines, aligned
+// so a copy never straddles a fourth.
+struct alignas(64) Position {
 	u64 colour[2];
 	u64 pieces[6];
-	// Incremental evaluation (PSQT sums + game phase) for fast Eval::evaluate().
-	Score psqt_sum[2];
-	i32 gamePhase;
-	bool eval_ready;
-
-	bool castling[4];
-	u64 ep;
-	bool flipped;
+	// Mailbox mirror of the bitboards: piece type per square (None if
+	// empty). Colour comes from colour[].
+	u8 board[64];
+	// Zobrist key, updated incrementally by make_move() and flip().
+	u64 key;
+	// Incremental evaluation for fast Eval::evaluate(): packed (mg, eg)
+	// PSQT sum of our pieces minus theirs, and the game phase.
+	i32 psqt;
+	u8 gamePhase;
+	u8 castling;        // CastlingRight bits
+	u8 ep;              // en-passant target square, NoSquare if none
+	u8 flipped : 1;
+	u8 eval_ready : 1;
+	// Check info for the side to move, refreshed by update_check_info():
+	// enemy pieces giving check, and our pieces pinned to our king.
+	u64 checkers;
+	u64 pinned;
 	Position();
 	void set_fen(const std::string& fen);
 	void refresh_eval();
 	void flip();
-	PieceType piece_on(i32 sq) const;
+	void make_null_move();
+	void make_null_move(StateInfo& st);
+	void unmake_null_move(const StateInfo& st);
+	// Castling rights as a KQkq bitmask in real (unflipped) colours.
+	i32 castle_index() const;
+	PieceType piece_on(i32 sq) const { return static_cast<PieceType>(board[sq]); }
 	u64 all_pieces() const { return colour[0] | colour[1]; }
+	u64 ep_bb() const { return ep == NoSquare ? 0 : BB::square_bb(ep); }
 	bool is_attacked(i32 sq, bool by_enemy = true) const;
-	bool make_move(const Move& move);
+	u64 attackers_to(i32 sq, u64 occupied) const;
+	void update_check_info();
+	u64 attacks_by(bool by_enemy = true) const;
+	// Whether an arbitrary move (e.g. from the TT or a killer slot) could
+	// have come from generate_moves() in this position.
+	bool is_pseudo_legal(const Move& move) const;
+	// Whether a pseudo-legal move from generate_moves() is legal.
+	bool is_legal(const Move& move) const;
+	// make_move() expects a legal move (see generate_legal()).
+	void make_move(const Move& move);
+	void make_move(const Move& move, StateInfo& st);
+	void unmake_move(const Move& move, const StateInfo& st);
+	bool is_ok() const;
 	void print() const;
 };
 
@@ -1,37 +1,28 @@
 #include "search.h"
 #include "movegen.h"
+#include "movepick.h"
 #include "eval.h"
 #include "tt.h"
 #include "bitboard.h"
+#include "numa.h"
 #include <iostream>
 #include <algorithm>
 #include <cstring>
 #include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-namespace Search {
-	
-	std::atomic<bool> stopped{false};
-	
-	u64 rep_stack[1024];
-	i32 game_ply = 0;
-	
-	i32 history[64][64];
-	Move killers[MAX_PLY][2];
-	i32 lmr_table[MAX_PLY][MAX_MOVES];
-	
-	i32 eval_stack[MAX_PLY + 4];
+namespace {
+	// Read-only after Search::init, so every Searcher can share it.
+	u8 lmr_table[MAX_PLY][MAX_MOVES];
 	
-	constexpr i32 MAX_HISTORY = 2000;
-	
-	const i32 MVV_LVA[6][6] = {
-		// attacker: P    N    B    R    Q    K
-		/* P */    { 15,  14,  13,  12,  11,  10 },
-		/* N */    { 25,  24,  23,  22,  21,  20 },
-		/* B */    { 35,  34,  33,  32,  31,  30 },
-		/* R */    { 45,  44,  43,  42,  41,  40 },
-		/* Q */    { 55,  54,  53,  52,  51,  50 },
-		/* K */    { 0,   0,   0,   0,   0,   0  },
-	};
+	// Helper threads skip some iterations so they spread over several
+	// depths instead of repeating the main thread's work.
+	constexpr i32 SKIP_SIZE[20]  = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+	constexpr i32 SKIP_PHASE[20] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
 	
 	void init_lmr_table() {
 		for (i32 depth = 0; depth < MAX_PLY; depth++) {
@@ -39,7 +30,7 @@ namespace Search {
 				if (depth == 0 || moves == 0) {
 					lmr_table[depth][moves] = 0;
 				} else {
-					lmr_table[depth][moves] = static_cast<i32>(
+					lmr_table[depth][moves] = static_cast<u8>(
 						0.5 + std::log(depth) * std::log(moves) * 0.5
 						);
 				}
@@ -48,450 +39,507 @@ namespace Search {
 	}
 	
 	inline Move flip_move(const Move& m) {
-		return Move(m.from ^ 56, m.to ^ 56, m.promo);
+		return Move(m.from() ^ 56, m.to() ^ 56, m.flags());
 	}
 	
-	inline void update_history(i32 from, i32 to, i32 bonus) {
-		i32& h = history[from][to];
-		bonus = std::clamp(bonus, -MAX_HISTORY, MAX_HISTORY);
-		h += bonus - h * std::abs(bonus) / MAX_HISTORY;
-	}
-	
-	inline void update_killers(i32 ply, const Move& move) {
-		if (!(killers[ply][0] == move)) {
-			killers[ply][1] = killers[ply][0];
-			killers[ply][0] = move;
-		}
-	}
-	
-	void clear_tables() {
-		std::memset(history, 0, sizeof(history));
-		std::memset(killers, 0, sizeof(killers));
-		std::memset(eval_stack, 0, sizeof(eval_stack));
-	}
-	
-	i32 score_move(const Position& pos, const Move& move, const Move& tt_move, i32 ply) {
-		if (move == tt_move) return 1000000;
+	void print_info(const SearchInfo& info, i32 multipv, const PVLine& line, const Position& pos) {
+		auto now = std::chrono::steady_clock::now();
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - info.start_time).count();
+		i32 score = line.score;
 		
-		PieceType captured = pos.piece_on(move.to);
+		std::cout << "info depth " << info.depth
+		<< " seldepth " << info.seldepth
+		<< " multipv " << multipv;
 		
-		if (captured != None) {
-			PieceType attacker = pos.piece_on(move.from);
-			return 100000 + MVV_LVA[captured][attacker];
+		if (score > MATE_SCORE - MAX_PLY) {
+			i32 mate_in = (MATE_SCORE - score + 1) / 2;
+			std::cout << " score mate " << mate_in;
+		} else if (score < -MATE_SCORE + MAX_PLY) {
+			i32 mate_in = -(MATE_SCORE + score + 1) / 2;
+			std::cout << " score mate " << mate_in;
+		} else {
+			std::cout << " score cp " << score;
 		}
 		
-		if (move.promo != None) {
-			return 95000 + move.promo;
+		std::cout << " nodes " << info.nodes
+		<< " time " << elapsed;
+		
+		if (elapsed > 0) {
+			std::cout << " nps " << (info.nodes * 1000 / elapsed);
 		}
 		
-		if (move == killers[ply][0]) return 90000;
-		if (move == killers[ply][1]) return 80000;
+		std::cout << " hashfull " << tt.hashfull();
+		
+		std::cout << " pv";
+		for (i32 i = 0; i < line.length; i++) {
+			std::cout << " " << move_to_string(line.moves[i], pos.flipped);
+		}
 		
-		return history[move.from][move.to];
+		std::cout << std::endl;
 	}
 	
-	void score_moves(const Position& pos, Move* moves, i32* scores, i32 count, const Move& tt_move, i32 ply) {
-		for (i32 i = 0; i < count; i++) {
-			scores[i] = score_move(pos, moves[i], tt_move, ply);
+	// Waiters on the stop flag, ponderhit or the timer. State changes are
+	// published under the mutex, so no wakeup can be lost. It also orders
+	// ponderhit against the soft limit setting stop_on_ponderhit.
+	std::mutex signal_mutex;
+	std::condition_variable signal;
+	
+	void notify() {
+		{
+			std::lock_guard<std::mutex> lock(signal_mutex);
 		}
+		signal.notify_all();
 	}
 	
-	void pick_move(Move* moves, i32* scores, i32 count, i32 current) {
-		i32 best_idx = current;
-		for (i32 i = current + 1; i < count; i++) {
-			if (scores[i] > scores[best_idx]) {
-				best_idx = i;
-			}
+	// Raises a stop flag at a deadline unless cancelled first, so the
+	// search itself never has to read the clock. While pondering the
+	// countdown has not started; it resumes at ponderhit against the
+	// original deadline.
+	class StopTimer {
+	public:
+		void start(std::atomic<bool>& flag, std::chrono::steady_clock::time_point deadline) {
+			cancel();
+			cancelled = false;
+			worker = std::thread([this, &flag, deadline]() {
+				std::unique_lock<std::mutex> lock(signal_mutex);
+				signal.wait(lock, [this]() { return cancelled || !Search::pondering.load(); });
+				if (!signal.wait_until(lock, deadline, [this]() { return cancelled; })) {
+					flag.store(true, std::memory_order_relaxed);
+				}
+			});
 		}
-		if (best_idx != current) {
-			std::swap(moves[current], moves[best_idx]);
-			std::swap(scores[current], scores[best_idx]);
+		
+		void cancel() {
+			{
+				std::lock_guard<std::mutex> lock(signal_mutex);
+				cancelled = true;
+			}
+			signal.notify_all();
+			if (worker.joinable()) worker.join();
 		}
+		
+	private:
+		std::thread worker;
+		bool cancelled = false;     // guarded by signal_mutex
+	};
+	
+	StopTimer timer;
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+// Searcher
+// ----------------------------------------------------------------------------
+
+Searcher::Searcher(i32 id, std::atomic<bool>& stop) : id(id), stopped(stop) {
+	clear();
+}
+
+void Searcher::clear() {
+	std::memset(history, 0, sizeof(history));
+	for (SearchStack& ss : stack) {
+		ss.killers[0] = ss.killers[1] = NullMove;
+		ss.static_eval = 0;
+		ss.pv_length = 0;
+	}
+}
+
+void Searcher::new_search(const u64* history_keys, i32 count) {
+	nodes.store(0, std::memory_order_relaxed);
+	seldepth = completed_depth = 0;
+	for (SearchStack& ss : stack) {
+		ss.killers[0] = ss.killers[1] = NullMove;
 	}
+	game_ply = count;
+	std::memcpy(rep_stack, history_keys, count * sizeof(u64));
+}
+
+void Searcher::update_history(i32 from, i32 to, i32 bonus) {
+	i32& h = history[from][to];
+	bonus = std::clamp(bonus, -MAX_HISTORY, MAX_HISTORY);
+	h += bonus - h * std::abs(bonus) / MAX_HISTORY;
+}
+
+void Searcher::update_killers(i32 ply, const Move& move) {
+	Move* killers = stack[ply].killers;
+	if (!(killers[0] == move)) {
+		killers[1] = killers[0];
+		killers[0] = move;
+	}
+}
+
+// Only the owning thread writes its counter, so a relaxed
+// load/store pair is enough and avoids a locked add.
+inline void Searcher::count_node() {
+	nodes.store(nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+inline i32 Searcher::evaluate(const Position& pos) {
+#ifdef USE_EVAL_CACHE
+	return eval_cache.probe(pos);
+#else
+	return Eval::evaluate(pos);
+#endif
+}
+
+i32 Searcher::quiescence(Position& pos, i32 alpha, i32 beta, i32 ply) {
+	if (stopped.load(std::memory_order_relaxed)) return 0;
+	
+	count_node();
+	if (ply > seldepth) seldepth = ply;
+	
+	i32 stand_pat = evaluate(pos);
+	
+	if (stand_pat >= beta) return beta;
+	if (stand_pat > alpha) alpha = stand_pat;
 	
-	bool check_time(SearchInfo& info) {
-		if (stopped.load(std::memory_order_relaxed)) return true;
+	MovePicker mp(pos);
+	Move move;
+	
+	while (!(move = mp.next_move()).is_none()) {
+#ifdef USE_UNMAKE
+		StateInfo st;
+		pos.make_move(move, st);
+		i32 score = -quiescence(pos, -beta, -alpha, ply + 1);
+		pos.unmake_move(move, st);
+#else
+		Position new_pos = pos;
+		new_pos.make_move(move);
+		
+		i32 score = -quiescence(new_pos, -beta, -alpha, ply + 1);
+#endif
+
+		if (stopped.load(std::memory_order_relaxed)) return 0;
 		
-		if (!info.infinite && (info.nodes & 2047) == 0) {
-			auto now = std::chrono::steady_clock::now();
-			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - info.start_time).count();
-			if (elapsed >= info.time_limit) {
-				stopped.store(true, std::memory_order_relaxed);
-				return true;
-			}
+		if (score >= beta) return beta;
+		if (score > alpha) alpha = score;
+	}
+	
+	return alpha;
+}
+
+// Root moves that earlier MultiPV lines of this iteration already own.
+bool Searcher::is_excluded(const Move& move) const {
+	for (i32 i = 0; i < pv_index; i++) {
+		if (lines[i].moves[0] == move) return true;
+	}
+	return false;
+}
+
+bool Searcher::is_repetition(u64 key, i32 ply) const {
+
+	for (i32 j = game_ply + ply - 2; j >= 0; j -= 2) {
+		if (rep_stack[j] == key) {
+			return true;
 		}
-		return false;
 	}
 	
-	i32 quiescence(Position& pos, i32 alpha, i32 beta, i32 ply, SearchInfo& info) {
-		if (check_time(info)) return 0;
-		
-		info.nodes++;
-		if (ply > info.seldepth) info.seldepth = ply;
-		
-		i32 stand_pat = Eval::evaluate(pos);
-		
-		if (stand_pat >= beta) return beta;
-		if (stand_pat > alpha) alpha = stand_pat;
-		
-		Move moves[MAX_MOVES];
-		i32 scores[MAX_MOVES];
-		i32 count = generate_moves(pos, moves, true);
-		
-		score_moves(pos, moves, scores, count, NullMove, ply);
+	return false;
+}
+
+i32 Searcher::alpha_beta(Position& pos, i32 depth, i32 alpha, i32 beta, i32 ply, bool is_root) {
+	SearchStack* ss = &stack[ply];
+	ss->pv_length = 0;
+	
+	if (stopped.load(std::memory_order_relaxed)) return 0;
+	
+	// The stack has no frame past MAX_PLY.
+	if (ply >= MAX_PLY - 1) return evaluate(pos);
+	
+	if (depth <= 0) {
+		return quiescence(pos, alpha, beta, ply);
+	}
+	
+	count_node();
+	u64 key = pos.key;
+	
+	rep_stack[game_ply + ply] = key;
+	if (!is_root && is_repetition(key, ply)) {
+		return 0;
+	}
+	
+	bool pv_node = (beta - alpha) > 1;
+	bool in_check = pos.checkers != 0;
+	
+	// Check extension
+	if (in_check) depth++;
+	
+	// Mate distance pruning
+	i32 mate_value = MATE_SCORE - ply;
+	if (mate_value < beta) {
+		beta = mate_value;
+		if (alpha >= mate_value) return mate_value;
+	}
+	mate_value = -MATE_SCORE + ply;
+	if (mate_value > alpha) {
+		alpha = mate_value;
+		if (beta <= mate_value) return mate_value;
+	}
+	
+	// TT lookup
+	TTEntry entry;
+	Move tt_move = NullMove;
+	bool tt_hit = tt.probe(key, entry);
+	
+	if (tt_hit) {
+		tt_move = entry.best_move;
 		
-		for (i32 i = 0; i < count; i++) {
-			pick_move(moves, scores, count, i);
-			
-			Position new_pos = pos;
-			if (!new_pos.make_move(moves[i])) continue;
-			
-			i32 score = -quiescence(new_pos, -beta, -alpha, ply + 1, info);
+		if (!is_root && entry.depth >= depth) {
+			i32 tt_score = entry.score;
 			
-			if (stopped.load(std::memory_order_relaxed)) return 0;
+			if (tt_score > MATE_SCORE - MAX_PLY) tt_score -= ply;
+			else if (tt_score < -MATE_SCORE + MAX_PLY) tt_score += ply;
 			
-			if (score >= beta) return beta;
-			if (score > alpha) alpha = score;
+			if (entry.flag() == TT_EXACT) return tt_score;
+			if (entry.flag() == TT_ALPHA && tt_score <= alpha) return alpha;
+			if (entry.flag() == TT_BETA && tt_score >= beta) return beta;
 		}
-		
-		return alpha;
 	}
 	
-	bool is_repetition(u64 key, i32 ply) {
-		
-		for (i32 j = game_ply + ply - 2; j >= 0; j -= 2) {
-			if (rep_stack[j] == key) {
-				return true;
+	// Static eval for improving heuristic; a TT hit already carries it.
+	i32 static_eval = in_check ? -INF : tt_hit ? entry.eval : evaluate(pos);
+	ss->static_eval = static_eval;
+	bool improving = !in_check && ply >= 2 && static_eval > (ss - 2)->static_eval;
+	
+	// =====================================================
+	// Reverse Futility Pruning (Static Null Move Pruning)
+	// =====================================================
+	if (!pv_node
+		&& !in_check
+		&& depth < 8
+		&& static_eval < MATE_SCORE - MAX_PLY
+		&& static_eval >= beta + 70 * depth - 70 * improving) {
+		return (static_eval + beta) / 2;
+	}
+	// =====================================================
+	// Null Move Pruning
+	// =====================================================
+	if (!pv_node
+		&& !in_check
+		&& depth >= 3
+		&& static_eval >= beta+20
+		&& beta > -MATE_SCORE + MAX_PLY
+		) {
+		u64 non_pawn = pos.colour[0] & ~pos.pieces[Pawn] & ~pos.pieces[King];
+		
+		if (non_pawn) {
+#ifdef USE_UNMAKE
+			StateInfo null_st;
+			Position& null_pos = pos;
+			pos.make_null_move(null_st);
+#else
+			Position null_pos = pos;
+			null_pos.make_null_move();
+#endif
+			tt.prefetch(null_pos.key);
+			i32 R = (static_eval - beta + depth * 30 + 480) / 105;
+			i32 null_score = -alpha_beta(
+				null_pos,
+				depth - R,
+				-beta, -beta + 1,
+				ply + 1,
+				false
+				);
+#ifdef USE_UNMAKE
+			pos.unmake_null_move(null_st);
+#endif
+
+			if (stopped.load(std::memory_order_relaxed)) return 0;
+			if (null_score >= beta) {
+				if (null_score >= MATE_SCORE - MAX_PLY) {
+					return beta;
+				}
+				return null_score;
 			}
 		}
-		
-		return false;
 	}
+	MovePicker mp(pos, tt_move, ss->killers, history);
+	Move move;
 	
-	i32 alpha_beta(Position& pos, i32 depth, i32 alpha, i32 beta, i32 ply, SearchInfo& info, Move* pv, i32& pv_len, bool is_root) {
-		pv_len = 0;
-		
-		if (check_time(info)) return 0;
+	i32 legal_moves = 0;
+	i32 best_score = -INF;
+	Move best_move = NullMove;
+	u8 tt_flag = TT_ALPHA;
+	
+	const SearchStack* child = ss + 1;
+	i32 quiets_count = 0;
+	
+	while (!(move = mp.next_move()).is_none()) {
+		if (is_root && is_excluded(move)) continue;
 		
-		if (depth <= 0) {
-			return quiescence(pos, alpha, beta, ply, info);
+		bool is_quiet = move.is_quiet();
+		bool is_killer = (move == ss->killers[0]) || (move == ss->killers[1]);
+
+#ifdef USE_UNMAKE
+		StateInfo st;
+		Position& new_pos = pos;
+		pos.make_move(move, st);
+#else
+		Position new_pos = pos;
+		new_pos.make_move(move);
+#endif
+		// Start loading the child's bucket while LMP/LMR are decided.
+		tt.prefetch(new_pos.key);
+		
+		legal_moves++;
+		
+		if (!is_root
+			&& !pv_node
+			&& !in_check
+			&& is_quiet) {
+			
+			i32 lmp_threshold = (depth * depth + 10) >> (2 - improving);
+			
+			if (quiets_count >= lmp_threshold) {
+#ifdef USE_UNMAKE
+				pos.unmake_move(move, st);
+#endif
+				break;
+			}
 		}
-		
-		info.nodes++;
-		u64 key = Zobrist::hash(pos);
-		
-		rep_stack[game_ply + ply] = key;
-		if (!is_root && is_repetition(key, ply)) {
-			return 0;
+		if (is_quiet) {
+			ss->quiets[quiets_count++] = move;
 		}
 		
-		bool pv_node = (beta - alpha) > 1;
-		i32 king_sq = BB::lsb(pos.colour[0] & pos.pieces[King]);
-		bool in_check = pos.is_attacked(king_sq);
-		
-		// Check extension
-		if (in_check) depth++;
-		
-		// Mate distance pruning
-		i32 mate_value = MATE_SCORE - ply;
-		if (mate_value < beta) {
-			beta = mate_value;
-			if (alpha >= mate_value) return mate_value;
-		}
-		mate_value = -MATE_SCORE + ply;
-		if (mate_value > alpha) {
-			alpha = mate_value;
-			if (beta <= mate_value) return mate_value;
-		}
+		i32 score;
+		i32 new_depth = depth - 1;
 		
-		// TT lookup
-		TTEntry* entry = tt.probe(key);
-		Move tt_move = NullMove;
+		// ============================================
+		// PVS (Principal Variation Search)
+		// ============================================
 		
-		if (entry) {
-			tt_move = entry->best_move;
+		if (legal_moves == 1) {
+			// First move: full window search (this is expected to be the best move)
+			score = -alpha_beta(new_pos, new_depth, -beta, -alpha, ply + 1, false);
+		} else {
+			// Late Move Reduction
+			i32 reduction = 0;
 			
-			if (!is_root && entry->depth >= depth) {
-				i32 tt_score = entry->score;
+			if (depth >= 3 && is_quiet && !in_check) {
+				reduction = lmr_table[std::min(depth, MAX_PLY - 1)][std::min(legal_moves, MAX_MOVES - 1)];
 				
-				if (tt_score > MATE_SCORE - MAX_PLY) tt_score -= ply;
-				else if (tt_score < -MATE_SCORE + MAX_PLY) tt_score += ply;
+				if (pv_node) reduction--;
+				if (improving) reduction--;
+				if (is_killer) reduction--;
 				
-				if (entry->flag == TT_EXACT) return tt_score;
-				if (entry->flag == TT_ALPHA && tt_score <= alpha) return alpha;
-				if (entry->flag == TT_BETA && tt_score >= beta) return beta;
+				reduction -= history[move.from()][move.to()] / 4096;
+				reduction = std::clamp(reduction, 0, new_depth - 1);
 			}
-		}
-		
-		// Static eval for improving heuristic
-		i32 static_eval = in_check ? -INF : Eval::evaluate(pos);
-		eval_stack[ply] = static_eval;
-		bool improving = !in_check && ply >= 2 && static_eval > eval_stack[ply - 2];
-		
-		// =====================================================
-		// Reverse Futility Pruning (Static Null Move Pruning)
-		// =====================================================
-		if (!pv_node
-			&& !in_check
-			&& depth < 8
-			&& static_eval < MATE_SCORE - MAX_PLY
-			&& static_eval >= beta + 70 * depth - 70 * improving) {
-			return (static_eval + beta) / 2;
-		}
-		// =====================================================
-// Null Move Pruning 
-// =====================================================
-		if (!pv_node
-			&& !in_check
-			&& depth >= 3
-			&& static_eval >= beta+20
-			&& beta > -MATE_SCORE + MAX_PLY  
-			) {
-			u64 non_pawn = pos.colour[0] & ~pos.pieces[Pawn] & ~pos.pieces[King];
 			
-			if (non_pawn) {
-				Position null_pos = pos;
-				null_pos.ep = 0;      
-				null_pos.flip();     
-				i32 R = (static_eval - beta + depth * 30 + 480) / 105;
-				Move null_pv[1];      
-				i32 null_pv_len = 0;
-				i32 null_score = -alpha_beta(
-					null_pos,
-					depth - R,        
-					-beta, -beta + 1,
-					ply + 1,
-					info,
-					null_pv, null_pv_len,
-					false
-					);
+			// PVS(50 Elo)
+			score = -alpha_beta(new_pos, new_depth - reduction, -alpha - 1, -alpha, ply + 1, false);
+			
+			// If null window search fails high (score > alpha), we need to re-search
+			if (score > alpha && score < beta) {
+				// Re-search with full window
+				score = -alpha_beta(new_pos, new_depth, -beta, -alpha, ply + 1, false);
+			}
+			// Ifused LMR and it failed high on the null window, verify with full depth
+			else if (score > alpha && reduction > 0) {
+				// First verify with full depth but null window
+				score = -alpha_beta(new_pos, new_depth, -alpha - 1, -alpha, ply + 1, false);
 				
-				if (stopped.load(std::memory_order_relaxed)) return 0;
-				if (null_score >= beta) {
-					if (null_score >= MATE_SCORE - MAX_PLY) {
-						return beta;
-					}
-					return null_score;
+				// If still fails high, do full window search
+				if (score > alpha && score < beta) {
+					score = -alpha_beta(new_pos, new_depth, -beta, -alpha, ply + 1, false);
 				}
 			}
 		}
-		Move moves[MAX_MOVES];
-		i32 scores[MAX_MOVES];
-		i32 count = generate_moves(pos, moves, false);
-		
-		score_moves(pos, moves, scores, count, tt_move, ply);
-		
-		i32 legal_moves = 0;
-		i32 best_score = -INF;
-		Move best_move = NullMove;
-		u8 tt_flag = TT_ALPHA;
-		
-		Move child_pv[MAX_PLY];
-		i32 child_pv_len;
-		
-		Move quiets_tried[MAX_MOVES];
-		i32 quiets_count = 0;
+
+#ifdef USE_UNMAKE
+		pos.unmake_move(move, st);
+#endif
+
+		if (stopped.load(std::memory_order_relaxed)) return 0;
 		
-		for (i32 i = 0; i < count; i++) {
-			pick_move(moves, scores, count, i);
-			
-			Position new_pos = pos;
-			if (!new_pos.make_move(moves[i])) continue;
-			
-			legal_moves++;
-			
-			bool is_capture = pos.piece_on(moves[i].to) != None;
-			bool is_promo = moves[i].promo != None;
-			bool is_quiet = !is_capture && !is_promo;
-			bool is_killer = (moves[i] == killers[ply][0]) || (moves[i] == killers[ply][1]);
-			if (!is_root
-				&& !pv_node
-				&& !in_check
-				&& is_quiet) {
-				
-				i32 lmp_threshold = (depth * depth + 10) >> (2 - improving);
-				
-				if (quiets_count >= lmp_threshold) {
-					break;
-				}
-			}
-			if (is_quiet) {
-				quiets_tried[quiets_count++] = moves[i];
-			}
+		if (score > best_score) {
+			best_score = score;
+			best_move = move;
 			
-			i32 score;
-			i32 new_depth = depth - 1;
-			
-			// ============================================
-			// PVS (Principal Variation Search)
-			// ============================================
-			
-			if (legal_moves == 1) {
-				// First move: full window search (this is expected to be the best move)
-				score = -alpha_beta(new_pos, new_depth, -beta, -alpha, ply + 1, info, child_pv, child_pv_len, false);
-			} else {
-				// Late Move Reduction
-				i32 reduction = 0;
+			if (score > alpha) {
+				alpha = score;
+				tt_flag = TT_EXACT;
 				
-				if (depth >= 3 && is_quiet && !in_check) {
-					reduction = lmr_table[std::min(depth, MAX_PLY - 1)][std::min(legal_moves, MAX_MOVES - 1)];
-					
-					if (pv_node) reduction--;
-					if (improving) reduction--;
-					if (is_killer) reduction--;
-					
-					reduction -= history[moves[i].from][moves[i].to] / 4096;
-					reduction = std::clamp(reduction, 0, new_depth - 1);
+				ss->pv[0] = move;
+				for (i32 j = 0; j < child->pv_length; j++) {
+					ss->pv[j + 1] = flip_move(child->pv[j]);
 				}
+				ss->pv_length = child->pv_length + 1;
 				
-				// PVS(50 Elo)
-				score = -alpha_beta(new_pos, new_depth - reduction, -alpha - 1, -alpha, ply + 1, info, child_pv, child_pv_len, false);
-				
-				// If null window search fails high (score > alpha), we need to re-search
-				if (score > alpha && score < beta) {
-					// Re-search with full window
-					score = -alpha_beta(new_pos, new_depth, -beta, -alpha, ply + 1, info, child_pv, child_pv_len, false);
-				}
-				// Ifused LMR and it failed high on the null window, verify with full depth
-				else if (score > alpha && reduction > 0) {
-					// First verify with full depth but null window
-					score = -alpha_beta(new_pos, new_depth, -alpha - 1, -alpha, ply + 1, info, child_pv, child_pv_len, false);
-					
-					// If still fails high, do full window search
-					if (score > alpha && score < beta) {
-						score = -alpha_beta(new_pos, new_depth, -beta, -alpha, ply + 1, info, child_pv, child_pv_len, false);
+				if (score >= beta) {
+					if (is_quiet) {
+						update_killers(ply, move);
+						
+						i32 bonus = depth * depth;
+						update_history(move.from(), move.to(), bonus);
+						
+						for (i32 j = 0; j < quiets_count - 1; j++) {
+							update_history(ss->quiets[j].from(), ss->quiets[j].to(), -bonus);
+						}
 					}
-				}
-			}
-			
-			if (stopped.load(std::memory_order_relaxed)) return 0;
-			
-			if (score > best_score) {
-				best_score = score;
-				best_move = moves[i];
-				
-				if (score > alpha) {
-					alpha = score;
-					tt_flag = TT_EXACT;
 					
-					pv[0] = moves[i];
-					for (i32 j = 0; j < child_pv_len; j++) {
-						pv[j + 1] = flip_move(child_pv[j]);
-					}
-					pv_len = child_pv_len + 1;
+					i32 store_score = best_score;
+					if (store_score > MATE_SCORE - MAX_PLY) store_score += ply;
+					else if (store_score < -MATE_SCORE + MAX_PLY) store_score -= ply;
 					
-					if (score >= beta) {
-						if (is_quiet) {
-							update_killers(ply, moves[i]);
-							
-							i32 bonus = depth * depth;
-							update_history(moves[i].from, moves[i].to, bonus);
-							
-							for (i32 j = 0; j < quiets_count - 1; j++) {
-								update_history(quiets_tried[j].from, quiets_tried[j].to, -bonus);
-							}
-						}
-						
-						i32 store_score = best_score;
-						if (store_score > MATE_SCORE - MAX_PLY) store_score += ply;
-						else if (store_score < -MATE_SCORE + MAX_PLY) store_score -= ply;
-						
-						tt.store(key, depth, store_score, TT_BETA, best_move);
-						return beta;
+					if (!is_root || pv_index == 0) {
+						tt.store(key, depth, store_score, static_eval, TT_BETA, best_move);
 					}
+					return beta;
 				}
 			}
 		}
-		
-		// Checkmate or stalemate
-		if (legal_moves == 0) {
-			if (in_check) {
-				return -MATE_SCORE + ply;
-			} else {
-				return 0;
-			}
-		}
-		
-		// Store in TT
-		i32 store_score = best_score;
-		if (store_score > MATE_SCORE - MAX_PLY) store_score += ply;
-		else if (store_score < -MATE_SCORE + MAX_PLY) store_score -= ply;
-		
-		tt.store(key, depth, store_score, tt_flag, best_move);
-		
-		return best_score;
 	}
 	
-	void print_info(SearchInfo& info, i32 score, const Position& pos) {
-		auto now = std::chrono::steady_clock::now();
-		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - info.start_time).count();
-		
-		std::cout << "info depth " << info.depth
-		<< " seldepth " << info.seldepth;
-		
-		if (score > MATE_SCORE - MAX_PLY) {
-			i32 mate_in = (MATE_SCORE - score + 1) / 2;
-			std::cout << " score mate " << mate_in;
-		} else if (score < -MATE_SCORE + MAX_PLY) {
-			i32 mate_in = -(MATE_SCORE + score + 1) / 2;
-			std::cout << " score mate " << mate_in;
+	// Checkmate or stalemate
+	if (legal_moves == 0) {
+		if (in_check) {
+			return -MATE_SCORE + ply;
 		} else {
-			std::cout << " score cp " << score;
-		}
-		
-		std::cout << " nodes " << info.nodes
-		<< " time " << elapsed;
-		
-		if (elapsed > 0) {
-			std::cout << " nps " << (info.nodes * 1000 / elapsed);
-		}
-		
-		std::cout << " hashfull " << tt.hashfull();
-		
-		std::cout << " pv";
-		for (i32 i = 0; i < info.pv_length; i++) {
-			std::cout << " " << move_to_string(info.pv[i], pos.flipped);
+			return 0;
 		}
-		
-		std::cout << std::endl;
 	}
 	
-	void init() {
-		stopped.store(false);
-		game_ply = 0;
-		init_lmr_table();
-		clear_tables();
-	}
+	// Store in TT. Secondary MultiPV lines would overwrite the root
+	// entry with a move that is not the best one.
+	i32 store_score = best_score;
+	if (store_score > MATE_SCORE - MAX_PLY) store_score += ply;
+	else if (store_score < -MATE_SCORE + MAX_PLY) store_score -= ply;
 	
-	void stop() {
-		stopped.store(true, std::memory_order_relaxed);
+	if (!is_root || pv_index == 0) {
+		tt.store(key, depth, store_score, static_eval, tt_flag, best_move);
 	}
 	
-	Move search(Position& pos, SearchInfo& info, i32 max_depth) {
-		info.reset();
-		info.start_time = std::chrono::steady_clock::now();
-		stopped.store(false, std::memory_order_relaxed);
-		
-		std::memset(killers, 0, sizeof(killers));
+	return best_score;
+}
+
+void Searcher::iterate(Position& pos, SearchInfo& info, i32 max_depth, i32 multi) {
+	lines.assign(multi, PVLine());
+	std::vector<PVLine> last = lines;
+	
+	// Soft time limit bookkeeping (main thread only).
+	Move last_best = NullMove;
+	i32 stable = 0;
+	i32 last_score = 0;
+	
+	for (i32 depth = 1; depth <= max_depth; depth++) {
+		if (id > 0) {
+			i32 i = (id - 1) % 20;
+			if (((depth + SKIP_PHASE[i]) / SKIP_SIZE[i]) % 2) continue;
+		}
 		
-		Move best_move = NullMove;
-		i32 last_score = 0;
+		seldepth = 0;
 		
-		for (i32 depth = 1; depth <= max_depth; depth++) {
-			info.depth = depth;
-			info.seldepth = 0;
-			
-			Move pv[MAX_PLY];
-			i32 pv_len = 0;
+		for (pv_index = 0; pv_index < multi; pv_index++) {
+			PVLine& line = lines[pv_index];
 			
 			i32 score;
-			// Aspiration windows around the previous iteration's score.
+			// Aspiration windows around this line's previous score.
 			if (depth >= 4) {
 				i32 delta = 18;
-				i32 a = last_score - delta;
-				i32 b = last_score + delta;
+				i32 a = last[pv_index].score - delta;
+				i32 b = last[pv_index].score + delta;
 				while (true) {
-					score = alpha_beta(pos, depth, a, b, 0, info, pv, pv_len, true);
+					score = alpha_beta(pos, depth, a, b, 0, true);
 					if (stopped.load(std::memory_order_relaxed)) break;
 					if (score <= a) {
 						a -= delta;
@@ -506,26 +554,232 @@ namespace Search {
 					break;
 				}
 			} else {
-				score = alpha_beta(pos, depth, -INF, INF, 0, info, pv, pv_len, true);
+				score = alpha_beta(pos, depth, -INF, INF, 0, true);
 			}
 			
-			if (stopped.load(std::memory_order_relaxed) && depth > 1) break;
+			i32 pv_len = stack[0].pv_length;
+			if (stopped.load(std::memory_order_relaxed) && (depth > 1 || pv_len == 0)) break;
 			
+			line.score = score;
 			if (pv_len > 0) {
-				best_move = pv[0];
-				info.pv_length = pv_len;
-				std::memcpy(info.pv, pv, pv_len * sizeof(Move));
+				line.length = pv_len;
+				std::memcpy(line.moves, stack[0].pv, pv_len * sizeof(Move));
 			}
-			
-			print_info(info, score, pos);
+		}
+		
+		// An unfinished iteration would mix lines from two depths.
+		if (stopped.load(std::memory_order_relaxed) && depth > 1) {
+			lines = last;
+			break;
+		}
+		
+		// Fewer than `multi` lines only if depth 1 was cut short.
+		i32 done = pv_index;
+		std::stable_sort(lines.begin(), lines.begin() + done, [](const PVLine& a, const PVLine& b) {
+			return a.score > b.score;
+		});
+		last = lines;
+		completed_depth = depth;
+		
+		if (id == 0) {
+			info.depth = depth;
+			info.seldepth = seldepth;
+			info.nodes = Search::total_nodes();
+			info.pv_length = lines[0].length;
+			std::memcpy(info.pv, lines[0].moves, info.pv_length * sizeof(Move));
+			for (i32 k = 0; k < done; k++) {
+				print_info(info, k + 1, lines[k], pos);
+			}
+		}
+		
+		i32 score = lines[0].score;
+		if (score > MATE_SCORE - MAX_PLY || score < -MATE_SCORE + MAX_PLY) {
+			break;
+		}
+		
+		if (id == 0 && !info.infinite && info.soft_limit > 0) {
+			// Spend less when the best move keeps holding, more when it
+			// just changed or the score is falling.
+			stable = lines[0].moves[0] == last_best ? stable + 1 : 0;
+			last_best = lines[0].moves[0];
+			double scale = (1.25 - 0.1 * std::min(stable, 4))
+				* std::clamp(1.0 + (last_score - score) / 100.0, 0.8, 1.5);
 			last_score = score;
 			
-			if (score > MATE_SCORE - MAX_PLY || score < -MATE_SCORE + MAX_PLY) {
-				break;
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now() - info.start_time).count();
+			if (depth > 1 && elapsed >= info.soft_limit * scale) {
+				// Still the opponent's move: keep searching and leave the
+				// stop to ponderhit. Checked and set under the mutex so a
+				// ponderhit cannot land in between and miss the flag.
+				bool still_pondering;
+				{
+					std::lock_guard<std::mutex> lock(signal_mutex);
+					still_pondering = Search::pondering.load();
+					if (still_pondering) Search::stop_on_ponderhit.store(true);
+				}
+				if (!still_pondering) {
+					stopped.store(true, std::memory_order_relaxed);
+					break;
+				}
 			}
 		}
-		
-		return best_move;
+	}
+	pv_index = 0;
+#ifdef USE_EVAL_CACHE
+	eval_cache.flush_stats();
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Thread pool
+// ----------------------------------------------------------------------------
+
+namespace Search {
+
+	std::atomic<bool> stopped{false};
+	std::atomic<bool> pondering{false};
+	std::atomic<bool> stop_on_ponderhit{false};
+	
+	u64 rep_stack[1024];
+	i32 game_ply = 0;
+	
+	i32 multi_pv = 1;
+	
+	std::vector<std::unique_ptr<Searcher>> threads;
+	
+	u64 total_nodes() {
+		u64 sum = 0;
+		for (auto& th : threads) sum += th->node_count();
+		return sum;
 	}
 	
-} // namespace Search 
+	void clear_tables() {
+		for (auto& th : threads) th->clear();
+	}
+	
+	void set_threads(i32 count) {
+		count = std::clamp(count, 1, MAX_THREADS);
+		threads.resize(count);
+		for (i32 i = 0; i < count; i++) {
+			if (!threads[i]) {
+				threads[i] = std::make_unique<Searcher>(i, stopped);
+			}
+		}
+	}
+	
+	i32 thread_count() {
+		return static_cast<i32>(threads.size());
+	}
+	
+	void init() {
+		stopped.store(false);
+		game_ply = 0;
+		init_lmr_table();
+		set_threads(1);
+		clear_tables();
+	}
+	
+	void stop() {
+		stopped.store(true, std::memory_order_relaxed);
+		notify();
+	}
+	
+	void ponderhit() {
+		bool stop_now;
+		{
+			std::lock_guard<std::mutex> lock(signal_mutex);
+			pondering.store(false);
+			stop_now = stop_on_ponderhit.load();
+		}
+		signal.notify_all();
+		if (stop_now) stop();
+	}
+	
+	Move ponder_move(const Position& root, const SearchInfo& info) {
+		if (info.pv_length > 1) return info.pv[1];
+		if (info.pv_length == 0) return NullMove;
+		
+		Position child = root;
+		child.make_move(info.pv[0]);
+		TTEntry entry;
+		if (tt.probe(child.key, entry)
+			&& !entry.best_move.is_none()
+			&& child.is_pseudo_legal(entry.best_move)
+			&& child.is_legal(entry.best_move)) {
+			// PV moves are kept in the root's orientation.
+			return flip_move(entry.best_move);
+		}
+		return NullMove;
+	}
+	
+	// Lazy SMP: every thread searches the same root over the shared TT,
+	// and the helpers' entries steer the main thread's move ordering.
+	Move search(Position& pos, SearchInfo& info, i32 max_depth) {
+		info.reset();
+		info.start_time = std::chrono::steady_clock::now();
+		tt.new_search();
+		
+		// More lines than legal moves would leave the extra lines empty.
+		Move root_moves[MAX_MOVES];
+		i32 multi = std::clamp(generate_legal(pos, root_moves), 1, multi_pv);
+		
+		for (auto& th : threads) {
+			th->new_search(rep_stack, game_ply);
+		}
+		
+		if (!info.infinite) {
+			timer.start(stopped, info.start_time + std::chrono::milliseconds(info.hard_limit));
+		}
+		
+		// Copy the root before the main thread starts changing pos in place
+		// (make/unmake builds).
+		std::vector<Position> roots(thread_count(), pos);
+		std::vector<std::thread> helpers;
+		for (i32 i = 1; i < thread_count(); i++) {
+			helpers.emplace_back([&roots, &info, max_depth, i]() {
+				Numa::bind_thread(i);
+				threads[i]->iterate(roots[i], info, max_depth, 1);
+			});
+		}
+		
+		threads[0]->iterate(pos, info, max_depth, multi);
+		
+		// A ponder search that ran out of depth still owes its bestmove
+		// to ponderhit or stop.
+		{
+			std::unique_lock<std::mutex> lock(signal_mutex);
+			signal.wait(lock, []() { return !pondering.load() || stopped.load(); });
+		}
+		
+		stopped.store(true, std::memory_order_relaxed);
+		for (std::thread& t : helpers) t.join();
+		timer.cancel();
+		
+		// Prefer a helper that got deeper with a better score. Helpers
+		// search a single line, so MultiPV keeps the main thread's lines.
+		Searcher* best = threads[0].get();
+		if (multi == 1) {
+			for (auto& th : threads) {
+				if (th->completed_depth > best->completed_depth
+					&& th->lines[0].score > best->lines[0].score
+					&& th->lines[0].length > 0) {
+					best = th.get();
+				}
+			}
+		}
+		
+		info.nodes = total_nodes();
+		if (best != threads[0].get()) {
+			const PVLine& line = best->lines[0];
+			info.depth = best->completed_depth;
+			info.seldepth = best->seldepth;
+			info.pv_length = line.length;
+			std::memcpy(info.pv, line.moves, line.length * sizeof(Move));
+			print_info(info, 1, line, pos);
+		}
+		
+		return info.pv_length > 0 ? info.pv[0] : NullMove;
+	}
+
+} // namespace Search
@@ -3,14 +3,18 @@
 
 #include "types.h"
 #include "position.h"
+#include "eval.h"
 #include <atomic>
 #include <chrono>
+#include <vector>
 
 constexpr i32 INF = 30000;
 constexpr i32 MATE_SCORE = 29000;
 constexpr i32 MAX_PLY = 64;
-constexpr i32 MAX_MOVES = 1024;
-constexpr i32 MAX_HISTORY = 16384;
+constexpr i32 MAX_MOVES = 256;
+constexpr i32 MAX_HISTORY = 2000;
+constexpr i32 MAX_THREADS = 256;
+constexpr i32 MAX_MULTIPV = 256;
 
 struct SearchInfo {
 	u64 nodes;
@@ -20,11 +24,15 @@ struct SearchInfo {
 	i32 pv_length;
 	
 	std::chrono::steady_clock::time_point start_time;
-	i64 time_limit;
+	// Hard limit: the timer thread stops the search here. Soft limit:
+	// no new iteration starts past it (scaled by how settled the best
+	// move is); 0 means none. Both in ms, ignored when infinite.
+	i64 hard_limit;
+	i64 soft_limit;
 	bool infinite;
 	
 	SearchInfo() : nodes(0), depth(0), seldepth(0), pv_length(0), 
-	time_limit(0), infinite(true) {}
+	hard_limit(0), soft_limit(0), infinite(true) {}
 	
 	void reset() {
 		nodes = 0;
@@ -34,21 +42,101 @@ struct SearchInfo {
 	}
 };
 
+// One root line: its score and principal variation.
+struct PVLine {
+	i32 score = 0;
+	i32 length = 0;
+	Move moves[MAX_PLY];
+};
+
+// One frame of the search stack per ply. Frames are cache-line aligned
+// and sized for the worst case (218 legal moves), so a node touches only
+// its own few lines instead of kilobytes of fresh C++ stack.
+struct alignas(64) SearchStack {
+	Move pv[MAX_PLY];
+	i32 pv_length;
+	i32 static_eval;
+	Move killers[2];
+	Move quiets[MAX_MOVES];
+};
+
+// One search: its own per-ply stack, history and repetition history.
+// Searchers share only the TT and the stop flag they are given, so any
+// number of them can run side by side (Lazy SMP threads, or fully
+// independent searches).
+class Searcher {
+public:
+	Searcher(i32 id, std::atomic<bool>& stop);
+	
+	// Forgets history and killers (ucinewgame).
+	void clear();
+	// Resets per-search counters and copies the game history up to the
+	// root, which repetition detection looks back into.
+	void new_search(const u64* history, i32 count);
+	// Iterative deepening over `multi` root lines. Searcher 0 also
+	// applies the soft time limit in `info` and prints info lines.
+	void iterate(Position& pos, SearchInfo& info, i32 max_depth, i32 multi);
+	
+	u64 node_count() const { return nodes.load(std::memory_order_relaxed); }
+	
+	const i32 id;
+	i32 seldepth = 0;
+	i32 completed_depth = 0;
+	// Best lines of the last completed iteration, best first.
+	std::vector<PVLine> lines;
+	
+private:
+	i32 alpha_beta(Position& pos, i32 depth, i32 alpha, i32 beta, i32 ply, bool is_root);
+	i32 quiescence(Position& pos, i32 alpha, i32 beta, i32 ply);
+	bool is_excluded(const Move& move) const;
+	bool is_repetition(u64 key, i32 ply) const;
+	void update_history(i32 from, i32 to, i32 bonus);
+	void update_killers(i32 ply, const Move& move);
+	void count_node();
+	i32 evaluate(const Position& pos);
+	
+	std::atomic<bool>& stopped;
+	std::atomic<u64> nodes{0};     // read by searcher 0 for info output
+	// While line pv_index is searched, the root moves of
+	// lines[0..pv_index) are excluded.
+	i32 pv_index = 0;
+	i32 game_ply = 0;
+	
+	SearchStack stack[MAX_PLY + 1];
+	i32 history[64][64];
+	u64 rep_stack[1024 + MAX_PLY];
+#ifdef USE_EVAL_CACHE
+	Eval::EvalCache eval_cache;
+#endif
+};
+
 namespace Search {
 	extern std::atomic<bool> stopped;
+	// Set for 'go ponder' until ponderhit. The clock is the opponent's:
+	// the hard deadline is not armed and bestmove is held back.
+	extern std::atomic<bool> pondering;
+	// The soft limit ran out while pondering; stop as soon as ponderhit
+	// arrives.
+	extern std::atomic<bool> stop_on_ponderhit;
 	
+	// Game history up to the root; each thread copies it before searching.
 	extern u64 rep_stack[1024];
 	extern i32 game_ply;
 	
-	extern i32 history[64][64];
-	extern Move killers[MAX_PLY][2];
-	
-	extern i32 lmr_table[MAX_PLY][MAX_MOVES];
+	extern i32 multi_pv;
 	
 	void init();
 	void clear_tables();
+	void set_threads(i32 count);
+	i32 thread_count();
+	u64 total_nodes();
 	Move search(Position& pos, SearchInfo& info, i32 max_depth);
 	void stop();
+	// Turns a ponder search into a normal timed one, without restarting.
+	void ponderhit();
+	// The expected reply to the best move: second PV move, or the TT
+	// move after the best move when the PV was cut short. May be none.
+	Move ponder_move(const Position& root, const SearchInfo& info);
 }
 
 #endif // SEARCH_H
@@ -1,19 +1,92 @@
 #include "tt.h"
 #include "position.h"
 #include "bitboard.h"
+#include "numa.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <random>
 #include <iostream>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 TT tt;
 
+// ------------------------------------------------------------
+// Concurrency stress test (UCI "ttstress")
+// Every field stored is derived from the key, so a hit whose fields
+// disagree with its key can only come from a torn slot that slipped
+// past the XOR check.
+// ------------------------------------------------------------
+bool TT::stress(i32 threads, u64 ops_per_thread) {
+	TT table(1);    // small, so threads keep colliding on buckets
+	
+	std::atomic<u64> hits{0}, torn{0};
+	
+	auto worker = [&](u64 seed) {
+		std::mt19937_64 rng(seed);
+		u64 local_hits = 0, local_torn = 0;
+		for (u64 i = 0; i < ops_per_thread; i++) {
+			// A small key pool keeps probes hitting recent stores.
+			u64 key = (rng() % 65536 + 1) * 0x9E3779B97F4A7C15ULL;
+			u16 k = static_cast<u16>(key);
+			if (i & 1) {
+				TTEntry e;
+				if (!table.probe(key, e)) continue;
+				local_hits++;
+				bool ok = e.best_move == Move(k & 63, (k >> 6) & 63)
+					&& e.score == static_cast<i16>(k * 7)
+					&& e.depth == (k & 63) + 1
+					&& e.eval == static_cast<i16>(k * 3)
+					&& e.flag() == 1 + k % 3;
+				local_torn += !ok;
+			} else {
+				table.store(key, (k & 63) + 1, static_cast<i16>(k * 7), static_cast<i16>(k * 3),
+					u8(1 + k % 3), Move(k & 63, (k >> 6) & 63));
+			}
+		}
+		hits += local_hits;
+		torn += local_torn;
+	};
+	
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> pool;
+	for (i32 t = 0; t < threads; t++) pool.emplace_back(worker, 0x9E3779B97F4A7C15ULL * (t + 1));
+	for (auto& th : pool) th.join();
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	
+	u64 ops = u64(threads) * ops_per_thread;
+	std::cout << "Threads: " << threads << "\n";
+	std::cout << "Operations: " << ops << " (" << hits << " probe hits)\n";
+	std::cout << "Torn entries: " << torn << "\n";
+	std::cout << "Time: " << elapsed << " ms\n";
+	if (elapsed > 0) {
+		std::cout << "Ops/s: " << (ops * 1000 / elapsed) << "\n";
+	}
+	return torn == 0;
+}
+
 namespace Zobrist {
 	u64 piece_keys[2][6][64];
 	u64 castle_keys[16];
 	u64 ep_keys[8];
+	u64 side_key;
 	
 	void init() {
-		std::mt19937_64 rng(0x1234567890ABCDEF);
+		std::mt19937_64 rng(SEED);
 		
 		for (int c = 0; c < 2; c++) {
 			for (int pt = 0; pt < 6; pt++) {
@@ -30,6 +103,8 @@ namespace Zobrist {
 		for (int i = 0; i < 8; i++) {
 			ep_keys[i] = rng();
 		}
+		
+		side_key = rng();
 	}
 	
 	u64 hash(const Position& pos) {
@@ -39,91 +114,335 @@ namespace Zobrist {
 			u64 our = pos.colour[0] & pos.pieces[pt];
 			while (our) {
 				i32 sq = BB::pop_lsb(our);
-				h ^= piece_keys[0][pt][sq];
+				h ^= piece_key(pos.flipped, 0, pt, sq);
 			}
 			
 			u64 their = pos.colour[1] & pos.pieces[pt];
 			while (their) {
 				i32 sq = BB::pop_lsb(their);
-				h ^= piece_keys[1][pt][sq];
+				h ^= piece_key(pos.flipped, 1, pt, sq);
 			}
 		}
 		
-		int castle_idx = (pos.castling[0] ? 1 : 0) |
-		(pos.castling[1] ? 2 : 0) |
-		(pos.castling[2] ? 4 : 0) |
-		(pos.castling[3] ? 8 : 0);
-		h ^= castle_keys[castle_idx];
+		h ^= castle_keys[pos.castle_index()];
 		
-		if (pos.ep) {
-			int ep_file = file_of(BB::lsb(pos.ep));
+		if (pos.ep != NoSquare) {
+			int ep_file = file_of(pos.ep);
 			h ^= ep_keys[ep_file];
 		}
 		
+		if (pos.flipped) h ^= side_key;
+		
 		return h;
 	}
 }
 
-TT::TT() : table(nullptr), num_entries(0), used(0) {
-	resize(16);
+// ------------------------------------------------------------
+// Table memory
+// The table is 2 MB aligned so the kernel can back it with huge
+// pages: explicit hugetlb pages when some are reserved, otherwise
+// transparent huge pages via madvise().
+// ------------------------------------------------------------
+namespace {
+	constexpr size_t LargePageSize = 2 * 1024 * 1024;
+	
+	void* large_alloc(size_t size, bool& huge_tlb) {
+		huge_tlb = false;
+#if defined(_WIN32)
+		return _aligned_malloc(size, LargePageSize);
+#else
+#if defined(__linux__) && defined(MAP_HUGETLB)
+		void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (mem != MAP_FAILED) {
+			huge_tlb = true;
+			return mem;
+		}
+#endif
+		void* mem_thp = std::aligned_alloc(LargePageSize, size);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+		if (mem_thp) madvise(mem_thp, size, MADV_HUGEPAGE);
+#endif
+		return mem_thp;
+#endif
+	}
+	
+	// On-disk layout for savehash/loadhash: this header padded to one
+	// page, then the buckets exactly as they are in memory.
+	constexpr size_t FileHeaderSize = 4096;
+	constexpr char FileMagic[8] = "GeckoTT";
+	constexpr u32 FileVersion = 2;
+	
+	struct FileHeader {
+		char magic[8];
+		u32 version;
+		u32 entry_size;
+		u32 bucket_size;
+		u8 generation;
+		u64 num_buckets;
+		u64 zobrist_seed;
+		u64 zobrist_check;      // side_key, catches a changed key generator
+	};
+	
+	static_assert(sizeof(FileHeader) <= FileHeaderSize, "TT file header must fit in one page");
+} // anonymous namespace
+
+TT::TT(size_t mb) : table(nullptr), num_buckets(0), mapping(nullptr), mapping_size(0), memory(MEM_HEAP), generation(0) {
+	resize(mb);
 }
 
 TT::~TT() {
-	delete[] table;
+	release();
 }
 
-void TT::resize(size_t mb) {
-	delete[] table;
+void TT::release() {
+	if (mapping) {
+#if defined(_WIN32)
+		_aligned_free(mapping);
+#else
+		if (memory == MEM_HEAP) std::free(mapping);
+		else munmap(mapping, mapping_size);
+#endif
+	}
 	table = nullptr;
-	
+	mapping = nullptr;
+	mapping_size = 0;
+	memory = MEM_HEAP;
+}
+
+bool TT::resize(size_t mb) {
 	size_t bytes = mb * 1024ULL * 1024ULL;
-	num_entries = bytes / sizeof(TTEntry);
+	size_t buckets = std::max<size_t>(1, bytes / sizeof(TTBucket));
 	
-	if (num_entries == 0) num_entries = 1;
+	// aligned_alloc wants a multiple of the alignment.
+	size_t size = (buckets * sizeof(TTBucket) + LargePageSize - 1) / LargePageSize * LargePageSize;
+	bool huge_tlb;
+	void* mem = large_alloc(size, huge_tlb);
+	if (!mem) {
+		// Keep searching with the table we have.
+		std::cout << "info string Failed to allocate " << mb << " MB for the hash table, keeping "
+		<< size_mb() << " MB" << std::endl;
+		return false;
+	}
 	
-	table = new TTEntry[num_entries](); 
-	used = 0;
+	release();
+	mapping = mem;
+	mapping_size = size;
+	memory = huge_tlb ? MEM_HUGETLB : MEM_HEAP;
+	num_buckets = buckets;
+	table = static_cast<TTBucket*>(mapping);
+	// Place the pages before clear() first-touches them.
+	Numa::place_memory(table, mapping_size);
+	clear();
 	
-	size_t actual_mb = (num_entries * sizeof(TTEntry)) / (1024 * 1024);
-	std::cout << "info string Hash table: " << num_entries << " entries (" 
-	<< actual_mb << " MB, entry size " << sizeof(TTEntry) << " bytes)" << std::endl;
+	size_t actual_mb = (num_buckets * sizeof(TTBucket)) / (1024 * 1024);
+	std::cout << "info string Hash table: " << num_buckets * TT_BUCKET_SIZE << " entries (" 
+	<< actual_mb << " MB, entry size " << sizeof(TTSlot) << " bytes"
+	<< (memory == MEM_HUGETLB ? ", hugetlb pages" : "") << ")" << std::endl;
+	return true;
 }
 
+// Zeroing a multi-GB table is memory bound, so split it over all cores.
 void TT::clear() {
-	if (table && num_entries > 0) {
-		std::memset(table, 0, num_entries * sizeof(TTEntry));
+	generation = 0;
+	if (!table) return;
+	
+	size_t bytes = num_buckets * sizeof(TTBucket);
+	size_t threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = std::min(threads, bytes / (64 * 1024 * 1024) + 1);
+	
+	size_t chunk = (num_buckets + threads - 1) / threads;
+	std::vector<std::thread> workers;
+	for (size_t t = 0; t < threads; t++) {
+		size_t begin = t * chunk;
+		size_t end = std::min(num_buckets, begin + chunk);
+		if (begin >= end) break;
+		auto zero = [this, begin, end]() {
+			std::memset(static_cast<void*>(table + begin), 0, (end - begin) * sizeof(TTBucket));
+		};
+		if (t + 1 == threads) zero();
+		else workers.emplace_back(zero);
 	}
-	used = 0;
+	for (auto& w : workers) w.join();
 }
 
-void TT::store(u64 key, i32 depth, i32 score, u8 flag, Move move) {
-	size_t idx = key % num_entries;
-	TTEntry* entry = &table[idx];
+namespace {
+	TTEntry unpack(u64 word) {
+		TTEntry e;
+		std::memcpy(static_cast<void*>(&e), &word, sizeof(e));
+		return e;
+	}
 	
-	bool was_empty = (entry->key == 0);
+	u64 pack(const TTEntry& e) {
+		u64 word;
+		std::memcpy(&word, &e, sizeof(word));
+		return word;
+	}
+} // anonymous namespace
+
+void TT::store(u64 key, i32 depth, i32 score, i32 eval, u8 flag, Move move) {
+	TTSlot* slots = bucket(key)->slots;
 	
-	if (was_empty || entry->key == key || depth >= entry->depth) {
-		if (was_empty) used++;
-		
-		entry->key = key;
-		entry->depth = depth;
-		entry->score = score;
-		entry->flag = flag;
-		entry->best_move = move;
+	// Reuse the slot of the same position if there is one, otherwise
+	// evict the entry with the lowest depth, counting each search of age
+	// as 8 plies.
+	i32 replace = 0;
+	TTEntry old{};
+	bool same = false;
+	i32 worst = INT32_MAX;
+	for (i32 i = 0; i < TT_BUCKET_SIZE; i++) {
+		u64 data = slots[i].data.load(std::memory_order_relaxed);
+		u64 check = slots[i].check.load(std::memory_order_relaxed);
+		TTEntry e = unpack(data);
+		if ((check ^ data) == key || e.flag() == TT_NONE) {
+			replace = i;
+			old = e;
+			same = e.flag() != TT_NONE;
+			break;
+		}
+		i32 age = static_cast<u8>(generation - (e.genbound & ~3)) / GENERATION_DELTA;
+		i32 value = e.depth - 8 * age;
+		if (value < worst) {
+			worst = value;
+			replace = i;
+			old = e;
+		}
 	}
+	
+	// A shallower result for the same position only wins if it is exact
+	// or the stored one is from an earlier search.
+	if (same && flag != TT_EXACT && depth + 3 < old.depth
+		&& (old.genbound & ~3) == generation) {
+		return;
+	}
+	
+	TTEntry e;
+	// Keep the old move when this search found none.
+	e.best_move = (same && move.is_none()) ? old.best_move : move;
+	e.score = static_cast<i16>(score);
+	e.eval = static_cast<i16>(eval);
+	e.depth = static_cast<u8>(depth);
+	e.genbound = static_cast<u8>(generation | flag);
+	
+	u64 data = pack(e);
+	slots[replace].check.store(key ^ data, std::memory_order_relaxed);
+	slots[replace].data.store(data, std::memory_order_relaxed);
 }
 
-TTEntry* TT::probe(u64 key) {
-	size_t idx = key % num_entries;
-	TTEntry* entry = &table[idx];
+bool TT::probe(u64 key, TTEntry& entry) {
+	TTSlot* slots = bucket(key)->slots;
 	
-	if (entry->key == key) {
-		return entry;
+	for (i32 i = 0; i < TT_BUCKET_SIZE; i++) {
+		u64 data = slots[i].data.load(std::memory_order_relaxed);
+		u64 check = slots[i].check.load(std::memory_order_relaxed);
+		TTEntry e = unpack(data);
+		if ((check ^ data) == key && e.flag() != TT_NONE) {
+			// Refresh the generation so a hit is not aged out. Losing
+			// this race to a concurrent store is harmless.
+			if ((e.genbound & ~3) != generation) {
+				e.genbound = static_cast<u8>(generation | e.flag());
+				u64 refreshed = pack(e);
+				slots[i].check.store(key ^ refreshed, std::memory_order_relaxed);
+				slots[i].data.store(refreshed, std::memory_order_relaxed);
+			}
+			entry = e;
+			return true;
+		}
 	}
-	return nullptr;
+	return false;
 }
 
 int TT::hashfull() const {
-	if (num_entries == 0) return 0;
-	return static_cast<int>((used * 1000ULL) / num_entries);
+	size_t samples = std::min<size_t>(num_buckets, 1000 / TT_BUCKET_SIZE);
+	int count = 0;
+	for (size_t i = 0; i < samples; i++) {
+		for (const TTSlot& slot : table[i].slots) {
+			TTEntry e = unpack(slot.data.load(std::memory_order_relaxed));
+			count += e.flag() != TT_NONE && (e.genbound & ~3) == generation;
+		}
+	}
+	return static_cast<int>(count * 1000 / (samples * TT_BUCKET_SIZE));
+}
+
+// ------------------------------------------------------------
+// Persistence (UCI "savehash" / "loadhash")
+// ------------------------------------------------------------
+bool TT::save(const std::string& path) const {
+	FileHeader header{};
+	std::memcpy(header.magic, FileMagic, sizeof(header.magic));
+	header.version = FileVersion;
+	header.entry_size = sizeof(TTSlot);
+	header.bucket_size = TT_BUCKET_SIZE;
+	header.generation = generation;
+	header.num_buckets = num_buckets;
+	header.zobrist_seed = Zobrist::SEED;
+	header.zobrist_check = Zobrist::side_key;
+	
+	std::vector<char> page(FileHeaderSize, 0);
+	std::memcpy(page.data(), &header, sizeof(header));
+	
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(page.data(), FileHeaderSize);
+	file.write(reinterpret_cast<const char*>(table), num_buckets * sizeof(TTBucket));
+	if (!file) {
+		std::cout << "info string cannot write " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Maps the file privately instead of reading it: pages are faulted in
+// from the page cache as the search touches them, and writes stay in
+// memory (copy-on-write) without changing the file.
+bool TT::load(const std::string& path) {
+#if defined(_WIN32)
+	(void)path;
+	std::cout << "info string loadhash is not supported on this platform" << std::endl;
+	return false;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cout << "info string cannot open " << path << std::endl;
+		return false;
+	}
+	
+	FileHeader header{};
+	struct stat st;
+	bool ok = fstat(fd, &st) == 0
+		&& pread(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header))
+		&& std::memcmp(header.magic, FileMagic, sizeof(header.magic)) == 0
+		&& header.version == FileVersion
+		&& header.entry_size == sizeof(TTSlot)
+		&& header.bucket_size == TT_BUCKET_SIZE
+		&& header.zobrist_seed == Zobrist::SEED
+		&& header.zobrist_check == Zobrist::side_key
+		&& header.num_buckets > 0
+		&& u64(st.st_size) == FileHeaderSize + header.num_buckets * sizeof(TTBucket);
+	
+	if (!ok) {
+		close(fd);
+		std::cout << "info string " << path << " is not a compatible hash file" << std::endl;
+		return false;
+	}
+	
+	size_t size = st.st_size;
+	void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED) {
+		std::cout << "info string mmap of " << path << " failed" << std::endl;
+		return false;
+	}
+	
+	release();
+	mapping = mem;
+	mapping_size = size;
+	memory = MEM_FILE;
+	table = reinterpret_cast<TTBucket*>(static_cast<char*>(mem) + FileHeaderSize);
+	num_buckets = header.num_buckets;
+	generation = header.generation;
+	
+	std::cout << "info string Hash table: " << num_buckets * TT_BUCKET_SIZE << " entries ("
+	<< size_mb() << " MB, mapped from " << path << ")" << std::endl;
+	return true;
+#endif
 }
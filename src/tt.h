@@ -2,6 +2,8 @@
 #define TT_H
 
 #include "types.h"
+#include <atomic>
+#include <string>
 
 struct Position;
 
@@ -12,38 +14,113 @@ enum TTFlag : u8 {
 	TT_BETA = 3
 };
 
+// Entry data, one 64-bit word. In the table each slot pairs it with
+// key ^ data: a reader only accepts the slot if the two words still
+// XOR to its key, so a slot torn by concurrent writers reads as a miss.
 struct TTEntry {
-	u64 key;
-	i32 score;
-	i16 depth;
-	u8 flag;
 	Move best_move;
+	i16 score;
+	i16 eval;           // static eval, -INF when in check
+	u8 depth;
+	u8 genbound;        // generation in the top 6 bits, TTFlag in the low 2
+	
+	u8 flag() const { return genbound & 3; }
+};
+
+struct TTSlot {
+	std::atomic<u64> check;     // key ^ data
+	std::atomic<u64> data;      // packed TTEntry
+};
+
+constexpr i32 TT_BUCKET_SIZE = 4;
+
+// Four 16-byte slots per 64-byte bucket, so a probe touches a single
+// cache line.
+struct alignas(64) TTBucket {
+	TTSlot slots[TT_BUCKET_SIZE];
 };
 
+static_assert(sizeof(TTEntry) == 8, "TTEntry must stay 8 bytes");
+static_assert(std::atomic<u64>::is_always_lock_free, "TT entries need lock-free 64-bit atomics");
+static_assert(sizeof(TTBucket) == 64, "TTBucket must stay 64 bytes");
+
+constexpr size_t TT_MAX_MB = size_t(1) << 20;   // 1 TB
+
 class TT {
 public:
-	TT();
+	explicit TT(size_t mb = 16);
 	~TT();
 	
-	void resize(size_t mb);
+	// Returns false, keeping the current table, if the allocation fails.
+	bool resize(size_t mb);
 	void clear();
-	void store(u64 key, i32 depth, i32 score, u8 flag, Move move);
-	TTEntry* probe(u64 key);
+	// Called once per search; entries from older searches are replaced first.
+	void new_search() { generation += GENERATION_DELTA; }
+	void store(u64 key, i32 depth, i32 score, i32 eval, u8 flag, Move move);
+	// Copies the entry for `key` into `entry`. Safe to call while other
+	// threads store; best_move still needs the usual legality check.
+	bool probe(u64 key, TTEntry& entry);
+	// Hint the bucket for `key` into cache ahead of a probe.
+	void prefetch(u64 key) const { __builtin_prefetch(bucket(key)); }
+	// Permille of sampled entries written during the current search.
 	int hashfull() const;
-	size_t size_mb() const { return num_entries * sizeof(TTEntry) / (1024 * 1024); }
+	size_t size_mb() const { return num_buckets * sizeof(TTBucket) / (1024 * 1024); }
+	// True while the table is a mapping of a file opened by load().
+	bool file_mapped() const { return memory == MEM_FILE; }
+	
+	// Debug: `threads` threads hammer store/probe on a small table and
+	// count entries whose fields do not belong together. Returns true
+	// if none were found.
+	static bool stress(i32 threads, u64 ops_per_thread);
+	
+	// Writes the table to `path`, or maps a table saved earlier. load()
+	// replaces the current table, including its size, and rejects files
+	// from a different entry layout or Zobrist key set.
+	bool save(const std::string& path) const;
+	bool load(const std::string& path);
 	
 private:
-	TTEntry* table;
-	size_t num_entries;
-	size_t used;
+	static constexpr u8 GENERATION_DELTA = 4;   // skips the TTFlag bits
+	
+	TTBucket* bucket(u64 key) const {
+		// Multiply-shift maps the key onto [0, num_buckets) without a division.
+		__extension__ using u128 = unsigned __int128;
+		return &table[static_cast<u64>((static_cast<u128>(key) * num_buckets) >> 64)];
+	}
+	
+	enum Memory : u8 {
+		MEM_HEAP,       // aligned_alloc (transparent huge pages)
+		MEM_HUGETLB,    // anonymous MAP_HUGETLB mapping
+		MEM_FILE        // private mapping of a saved table
+	};
+	
+	void release();
+	
+	TTBucket* table;
+	size_t num_buckets;
+	void* mapping;      // start of the allocation; table may be offset in it
+	size_t mapping_size;
+	Memory memory;
+	u8 generation;
 };
 
 namespace Zobrist {
 	extern u64 piece_keys[2][6][64];
 	extern u64 castle_keys[16];
 	extern u64 ep_keys[8];
+	extern u64 side_key;
+	
+	constexpr u64 SEED = 0x1234567890ABCDEF;
+	
+	// Keys are absolute (white's view); Position::flipped maps the
+	// side-to-move relative board back to real colours and squares.
+	inline u64 piece_key(bool flipped, i32 colour, i32 pt, i32 sq) {
+		return piece_keys[colour ^ flipped][pt][flipped ? sq ^ 56 : sq];
+	}
 	
 	void init();
+	// Full recomputation. Position keeps its key incrementally; this is
+	// only used to (re)build it and to verify it in debug builds.
 	u64 hash(const Position& pos);
 }
 
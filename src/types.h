@@ -45,6 +45,19 @@ constexpr inline Score operator*(i32 k, const Score& a) { return a * k; }
 
 // Modern convenience macro
 #define S(mg, eg) Score((mg), (eg))
+
+// Score packed into one i32 (mg in the low half, eg in the high half)
+// so an incremental accumulator is a single add. Each half must stay
+// within i16.
+constexpr inline i32 pack_score(const Score& s) {
+	return static_cast<i32>(static_cast<u32>(s.eg) << 16) + s.mg;
+}
+
+inline Score unpack_score(i32 packed) {
+	i16 mg = static_cast<i16>(static_cast<u16>(static_cast<u32>(packed)));
+	i16 eg = static_cast<i16>(static_cast<u16>(static_cast<u32>(packed + 0x8000) >> 16));
+	return Score(mg, eg);
+}
 enum PieceType {
 	Pawn,
 	Knight, 
@@ -74,16 +87,41 @@ inline i32 rank_of(i32 sq) { return sq >> 3; }
 inline i32 file_of(i32 sq) { return sq & 7; }
 inline i32 make_square(i32 rank, i32 file) { return (rank << 3) | file; }
 
+// Move type flags, stored in the top 4 bits of a Move. Bit 2 marks
+// captures and bit 3 promotions, whose low two bits give the piece.
+enum MoveFlag : u16 {
+	Quiet       = 0,
+	DoublePush  = 1,
+	KingCastle  = 2,
+	QueenCastle = 3,
+	Capture     = 4,
+	EnPassant   = 5,
+	Promotion   = 8
+};
+
+// Packed move: from in bits 0-5, to in bits 6-11, MoveFlag in 12-15.
 struct Move {
-	u8 from;
-	u8 to;
-	u8 promo; 
+	u16 data;
+	
+	Move() : data(0) {}
+	Move(i32 f, i32 t, i32 flags = Quiet) : data(static_cast<u16>(f | (t << 6) | (flags << 12))) {}
 	
-	Move() : from(0), to(0), promo(None) {}
-	Move(u8 f, u8 t, u8 p = None) : from(f), to(t), promo(p) {}
+	i32 from() const { return data & 63; }
+	i32 to() const { return (data >> 6) & 63; }
+	i32 flags() const { return data >> 12; }
+	
+	bool is_capture() const { return data & (Capture << 12); }
+	bool is_promo() const { return data & (Promotion << 12); }
+	bool is_quiet() const { return !(data & ((Capture | Promotion) << 12)); }
+	bool is_ep() const { return flags() == EnPassant; }
+	bool is_double_push() const { return flags() == DoublePush; }
+	bool is_castle() const { return flags() == KingCastle || flags() == QueenCastle; }
+	PieceType promo() const {
+		return is_promo() ? static_cast<PieceType>(Knight + (flags() & 3)) : None;
+	}
 	
 	bool operator==(const Move& other) const {
-		return from == other.from && to == other.to && promo == other.promo;
+		return data == other.data;
 	}
 	
 	bool operator!=(const Move& other) const {
@@ -91,24 +129,26 @@ struct Move {
 	}
 	
 	bool is_none() const {
-		return from == 0 && to == 0 && promo == None;
+		return data == 0;
 	}
 };
 
+static_assert(sizeof(Move) == 2, "Move must stay 16 bits");
+
 const Move NullMove{};
 
 inline std::string move_to_string(const Move& move, bool flipped) {
 	if (move.is_none()) return "0000";
 	
 	std::string str;
-	str += 'a' + file_of(move.from);
-	str += '1' + (rank_of(move.from) ^ (flipped ? 7 : 0));
-	str += 'a' + file_of(move.to);
-	str += '1' + (rank_of(move.to) ^ (flipped ? 7 : 0));
+	str += 'a' + file_of(move.from());
+	str += '1' + (rank_of(move.from()) ^ (flipped ? 7 : 0));
+	str += 'a' + file_of(move.to());
+	str += '1' + (rank_of(move.to()) ^ (flipped ? 7 : 0));
 	
-	if (move.promo != None) {
+	if (move.is_promo()) {
 		const char promos[] = "nbrq";
-		str += promos[move.promo - Knight];
+		str += promos[move.promo() - Knight];
 	}
 	
 	return str;
@@ -5,6 +5,8 @@
 #include "eval.h"
 #include "tt.h"
 #include "bitboard.h"
+#include "numa.h"
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -36,11 +38,11 @@ namespace UCI {
 		// Parse moves
 		if (token == "moves") {
 			while (iss >> token) {
-				Search::rep_stack[Search::game_ply] = Zobrist::hash(pos);
+				Search::rep_stack[Search::game_ply] = pos.key;
 				Search::game_ply++;
 				
 				Move moves[256];
-				int count = generate_moves(pos, moves, false);
+				int count = generate_legal(pos, moves);
 				
 				for (int i = 0; i < count; i++) {
 					if (move_to_string(moves[i], pos.flipped) == token) {
@@ -57,7 +59,8 @@ namespace UCI {
 		search_info.infinite = true;
 		i32 max_depth = MAX_PLY;
 		
-		i64 wtime = 0, btime = 0, winc = 0, binc = 0, movetime = 0;
+		i64 wtime = 0, btime = 0, winc = 0, binc = 0, movetime = 0, movestogo = 0;
+		bool ponder = false;
 		
 		std::string token;
 		while (iss >> token) {
@@ -76,20 +79,31 @@ namespace UCI {
 				iss >> winc;
 			} else if (token == "binc") {
 				iss >> binc;
+			} else if (token == "movestogo") {
+				iss >> movestogo;
+			} else if (token == "ponder") {
+				ponder = true;
 			}
 		}
 		
 		// Time management
 		if (movetime > 0) {
-			search_info.time_limit = movetime;
+			search_info.hard_limit = movetime;
 			search_info.infinite = false;
 		} else if (wtime > 0 || btime > 0) {
 			i64 our_time = pos.flipped ? btime : wtime;
 			i64 our_inc = pos.flipped ? binc : winc;
+			// Keep a margin for GUI and process overhead.
+			i64 available = std::max(our_time - 50, (i64)1);
+			i64 moves_left = movestogo > 0 ? std::min(movestogo, (i64)30) : 30;
 			
-			search_info.time_limit = our_time / 30 + our_inc / 2;
-			search_info.time_limit = std::max(search_info.time_limit, (i64)100);
-			search_info.time_limit = std::min(search_info.time_limit, our_time - 50);
+			// Soft: the per-move share of the clock. Hard: room for an
+			// iteration that overruns it, but never the whole clock
+			// unless this is the last move before the time control.
+			i64 base = our_time / moves_left + our_inc / 2;
+			search_info.soft_limit = std::min(std::max(base, (i64)100), available);
+			search_info.hard_limit = moves_left == 1 ? available : std::min(base * 3, available / 2);
+			search_info.hard_limit = std::max(search_info.hard_limit, search_info.soft_limit);
 			search_info.infinite = false;
 		}
 		
@@ -101,13 +115,42 @@ namespace UCI {
 		Position search_pos = pos;
 		bool flipped = pos.flipped;
 		i32 depth = max_depth;
+		// Reset before the thread starts, so a stop or ponderhit sent
+		// right after 'go' is not undone by the search thread.
+		Search::stopped.store(false);
+		Search::stop_on_ponderhit.store(false);
+		Search::pondering.store(ponder);
 		
 		search_thread = std::thread([search_pos, flipped, depth]() mutable {
+			Numa::bind_thread(0);
 			Move best = Search::search(search_pos, search_info, depth);
-			std::cout << "bestmove " << move_to_string(best, flipped) << std::endl;
+			Move reply = best.is_none() ? NullMove : Search::ponder_move(search_pos, search_info);
+			std::cout << "bestmove " << move_to_string(best, flipped);
+			if (!reply.is_none()) {
+				std::cout << " ponder " << move_to_string(reply, flipped);
+			}
+			std::cout << std::endl;
 		});
 	}
 	
+	// Parses a spin option value into [min, max]. stoull would accept
+	// "-1" and wrap it, and stoi throws on empty or non-numeric input, so
+	// only plain digits are let through. Prints an info string and
+	// returns false on anything else.
+	bool parse_spin(const std::string& name, const std::string& value, size_t min, size_t max, size_t& out) {
+		out = 0;
+		if (!value.empty() && value.size() <= 8
+			&& value.find_first_not_of("0123456789") == std::string::npos) {
+			out = std::stoull(value);
+		}
+		if (out < min || out > max) {
+			std::cout << "info string Invalid " << name << " value '" << value
+			<< "', expected " << min << " to " << max << std::endl;
+			return false;
+		}
+		return true;
+	}
+	
 	void parse_setoption(std::istringstream& iss) {
 		std::string token;
 		iss >> token; // "name"
@@ -128,22 +171,59 @@ namespace UCI {
 		}
 		
 		if (option_name == "Hash") {
-			int mb = std::stoi(option_value);
-			mb = std::max(1, std::min(mb, 4096));
-			tt.resize(mb);
-			std::cout << "info string Hash set to " << mb << " MB" << std::endl;
+			size_t mb;
+			if (!parse_spin(option_name, option_value, 1, TT_MAX_MB, mb)) return;
+			if (search_thread.joinable()) {
+				Search::stop();
+				search_thread.join();
+			}
+			if (tt.resize(mb)) {
+				std::cout << "info string Hash set to " << mb << " MB" << std::endl;
+			}
+		}
+		else if (option_name == "Threads") {
+			size_t count;
+			if (!parse_spin(option_name, option_value, 1, MAX_THREADS, count)) return;
+			if (search_thread.joinable()) {
+				Search::stop();
+				search_thread.join();
+			}
+			Search::set_threads(static_cast<i32>(count));
+			std::cout << "info string Threads set to " << Search::thread_count() << std::endl;
+		}
+		else if (option_name == "MultiPV") {
+			size_t lines;
+			if (!parse_spin(option_name, option_value, 1, MAX_MULTIPV, lines)) return;
+			Search::multi_pv = static_cast<i32>(lines);
 		}
 		else if (option_name == "Clear Hash") {
 			tt.clear();
 			std::cout << "info string Hash cleared" << std::endl;
 		}
+		else if (option_name == "NUMA") {
+			// The search threads read the policy and use the table that
+			// is about to be replaced.
+			if (search_thread.joinable()) {
+				Search::stop();
+				search_thread.join();
+			}
+			if (Numa::set_policy(option_value)) {
+				// Reallocate so the new policy applies to every page. A
+				// table mapped by loadhash is kept: reallocating would
+				// throw it away.
+				if (!tt.file_mapped()) tt.resize(tt.size_mb());
+				std::cout << "info string NUMA set to " << option_value
+				<< " (" << Numa::node_count() << " nodes)" << std::endl;
+			}
+		}
 	}
 	
 	void loop() {
 		std::cout << "Gecko 0.14 by Bingwen Yang(sgtqwq)" << std::endl;
 		// UCI::pos is a global object, so its constructor can run before main()
-		// (and before Eval::init). Refresh incremental eval state here.
+		// (and before Eval::init / Zobrist::init). Refresh incremental state here.
 		pos.refresh_eval();
+		pos.key = Zobrist::hash(pos);
 		
 		std::string line;
 		while (std::getline(std::cin, line)) {
@@ -154,8 +234,12 @@ namespace UCI {
 			if (cmd == "uci") {
 				std::cout << "id name Gecko 0.14\n";
 				std::cout << "id author Bingwen Yang(sgtqwq)\n";
-				std::cout << "option name Hash type spin default 16 min 1 max 4096\n";
+				std::cout << "option name Hash type spin default 16 min 1 max " << TT_MAX_MB << "\n";
+				std::cout << "option name Threads type spin default 1 min 1 max " << MAX_THREADS << "\n";
+				std::cout << "option name MultiPV type spin default 1 min 1 max " << MAX_MULTIPV << "\n";
 				std::cout << "option name Clear Hash type button\n";
+				std::cout << "option name Ponder type check default false\n";
+				std::cout << "option name NUMA type combo default interleave var off var interleave var bind\n";
 				std::cout << "uciok\n";
 			}
 			else if (cmd == "isready") {
@@ -172,6 +256,9 @@ namespace UCI {
 			else if (cmd == "go") {
 				parse_go(iss);
 			}
+			else if (cmd == "ponderhit") {
+				Search::ponderhit();
+			}
 			else if (cmd == "stop") {
 				Search::stop();
 				if (search_thread.joinable()) {
@@ -179,10 +266,6 @@ namespace UCI {
 				}
 			}
 			else if (cmd == "quit") {
-				Search::stop();
-				if (search_thread.joinable()) {
-					search_thread.join();
-				}
 				break;
 			}
 			else if (cmd == "setoption") {
@@ -194,11 +277,15 @@ namespace UCI {
 			else if (cmd == "eval") {
 				std::cout << "Eval: " << Eval::evaluate(pos) << " cp\n";
 			}
+			else if (cmd == "evalstats") {
+				Eval::print_cache_stats();
+			}
 			else if (cmd == "perft") {
-				int depth;
-				iss >> depth;
+				int depth = 1;
+				int threads = std::max(1u, std::thread::hardware_concurrency());
+				iss >> depth >> threads;
 				auto start = std::chrono::steady_clock::now();
-				u64 nodes = perft(pos, depth);
+				u64 nodes = perft_parallel(pos, depth, threads);
 				auto end = std::chrono::steady_clock::now();
 				auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
 				std::cout << "Nodes: " << nodes << "\n";
@@ -207,6 +294,47 @@ namespace UCI {
 					std::cout << "NPS: " << (nodes * 1000 / elapsed.count()) << "\n";
 				}
 			}
+			else if (cmd == "divide") {
+				int depth = 1;
+				int threads = std::max(1u, std::thread::hardware_concurrency());
+				iss >> depth >> threads;
+				perft_divide(pos, depth, threads);
+			}
+			else if (cmd == "perftsuite") {
+				std::string path;
+				int max_depth = MAX_PLY;
+				int threads = std::max(1u, std::thread::hardware_concurrency());
+				iss >> path >> max_depth >> threads;
+				perft_suite(path, max_depth, threads);
+			}
+			else if (cmd == "savehash" || cmd == "loadhash") {
+				std::string path;
+				iss >> path;
+				if (search_thread.joinable()) {
+					Search::stop();
+					search_thread.join();
+				}
+				bool ok = cmd == "savehash" ? tt.save(path) : tt.load(path);
+				if (ok && cmd == "savehash") {
+					std::cout << "info string Hash saved to " << path << std::endl;
+				}
+			}
+			else if (cmd == "ttstress") {
+				int threads = 4;
+				u64 ops = 10000000;
+				iss >> threads >> ops;
+				TT::stress(std::max(1, threads), ops);
+			}
+			else if (cmd == "sliderbench") {
+				BB::bench_sliders();
+			}
+		}
+		
+		// On quit or end of input, the search thread must be joined
+		// before it is destroyed.
+		Search::stop();
+		if (search_thread.joinable()) {
+			search_thread.join();
 		}
 	}
 	